@@ -0,0 +1,144 @@
+// collision broad phase
+
+#include "collision_grid.hpp"
+#include "object_costs.hpp"
+#include <algorithm>
+#include <cmath>
+#include <unordered_set>
+
+CollisionGrid::CellRange CollisionGrid::rangeOf(CCRect const& rect) {
+    return {
+        static_cast<int>(std::floor(rect.getMinX() / kCellSize)),
+        static_cast<int>(std::floor(rect.getMinY() / kCellSize)),
+        static_cast<int>(std::floor(rect.getMaxX() / kCellSize)),
+        static_cast<int>(std::floor(rect.getMaxY() / kCellSize)),
+    };
+}
+
+void CollisionGrid::link(Entry& entry) {
+    auto& r = entry.range;
+    for (int x = r.x0; x <= r.x1; x++) {
+        for (int y = r.y0; y <= r.y1; y++) cells[key(x, y)].push_back(&entry);
+    }
+}
+
+void CollisionGrid::unlink(Entry& entry) {
+    auto& r = entry.range;
+    for (int x = r.x0; x <= r.x1; x++) {
+        for (int y = r.y0; y <= r.y1; y++) {
+            auto it = cells.find(key(x, y));
+            if (it == cells.end()) continue;
+            auto& list = it->second;
+            auto found = std::find(list.begin(), list.end(), &entry);
+            if (found == list.end()) continue;
+            *found = list.back();
+            list.pop_back();
+        }
+    }
+}
+
+void CollisionGrid::build(GJBaseGameLayer* level) {
+    clear();
+    layer = level;
+    if (!level->m_objects) return;
+
+    // m_objects still holds what the strips took out of the sections, and
+    // those never reach a collision pass
+    std::unordered_set<GameObject*> stripped;
+    for (auto* strip : {&g_highDetailStrip, &g_lodStrip}) {
+        if (strip->layer != level) continue;
+        for (auto& object : strip->removed) stripped.insert(object);
+    }
+
+    for (auto* object : CCArrayExt<GameObject*>(level->m_objects)) {
+        if (tracked(object) && !stripped.contains(object)) add(object);
+    }
+}
+
+void CollisionGrid::clear() {
+    layer = nullptr;
+    entries.clear();
+    cells.clear();
+    lastPosition.clear();
+    nearby.clear();
+    candidates.clear();
+    rects.clear();
+    pass = 0;
+    servedIn.clear();
+}
+
+void CollisionGrid::add(GameObject* object) {
+    auto [it, added] = entries.try_emplace(object);
+    if (!added) return;
+    auto& entry = it->second;
+    entry.object = object;
+    entry.rect = object->getObjectRect();
+    entry.range = rangeOf(entry.rect);
+    link(entry);
+}
+
+void CollisionGrid::remove(GameObject* object) {
+    auto it = entries.find(object);
+    if (it == entries.end()) return;
+    unlink(it->second);
+    entries.erase(it);
+}
+
+void CollisionGrid::moved(GameObject* object) {
+    auto it = entries.find(object);
+    if (it == entries.end()) return;
+    auto& entry = it->second;
+    entry.rect = object->getObjectRect();
+    auto range = rangeOf(entry.rect);
+    if (range == entry.range) return;
+    unlink(entry);
+    entry.range = range;
+    link(entry);
+}
+
+bool CollisionGrid::serve(PlayerObject* player) {
+    if (!pass) return true;
+    auto& last = servedIn[player];
+    if (last == pass) return false;
+    last = pass;
+    return true;
+}
+
+std::vector<GameObject*>& CollisionGrid::query(PlayerObject* player) {
+    auto pos = player->getPosition();
+    auto [last, added] = lastPosition.try_emplace(player, pos);
+    float reach = kPad;
+    if (!added) {
+        reach += (std::abs(pos.x - last->second.x) + std::abs(pos.y - last->second.y)) * 2.0f;
+        last->second = pos;
+    }
+
+    auto box = player->getObjectRect();
+    box.origin.x -= reach;
+    box.origin.y -= reach;
+    box.size.width += reach * 2.0f;
+    box.size.height += reach * 2.0f;
+
+    nearby.clear();
+    rects.clear();
+    stamp++;
+    auto r = rangeOf(box);
+    for (int x = r.x0; x <= r.x1; x++) {
+        for (int y = r.y0; y <= r.y1; y++) {
+            auto it = cells.find(key(x, y));
+            if (it == cells.end()) continue;
+            for (auto* entry : it->second) {
+                if (entry->stamp == stamp) continue;
+                entry->stamp = stamp;
+                nearby.push_back(entry->object);
+                rects.push(entry->rect);
+            }
+        }
+    }
+
+    hits.clear();
+    overlapRects(rects, box, hits);
+    candidates.clear();
+    for (auto i : hits) candidates.push_back(nearby[i]);
+    return candidates;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+// uniform grid over a level's collidable objects, so a collision pass only
+// looks at the cells around the player instead of whole sections
+
+#include "globals.hpp"
+#include "collision_kernel.hpp"
+
+struct CollisionGrid {
+    // cells an object's rect covers, inclusive
+    struct CellRange {
+        int x0 = 0, y0 = 0, x1 = -1, y1 = -1;
+
+        bool operator==(CellRange const&) const = default;
+    };
+
+    struct Entry {
+        GameObject* object = nullptr;
+        cocos2d::CCRect rect;  // refreshed on every move, rotation and scale
+        CellRange range;
+        unsigned stamp = 0;  // last query that returned it
+    };
+
+    static constexpr float kCellSize = 90.0f;  // three blocks
+    // the cached rects are current, this only covers gd's own tests reaching
+    // a little past the player's rect (slope snapping, ring and pad radii)
+    static constexpr float kPad = 30.0f;
+
+    GJBaseGameLayer* layer = nullptr;
+    std::unordered_map<GameObject*, Entry> entries;
+    std::unordered_map<int64_t, std::vector<Entry*>> cells;
+    std::unordered_map<PlayerObject*, cocos2d::CCPoint> lastPosition;
+    std::vector<GameObject*> nearby;      // everything in the cells
+    std::vector<GameObject*> candidates;  // the ones touching the box
+    RectSoA rects;
+    std::vector<uint32_t> hits;
+    unsigned stamp = 0;
+    unsigned pass = 0;    // current checkCollisions call, 0 outside one
+    unsigned passes = 0;
+    std::unordered_map<PlayerObject*, unsigned> servedIn;  // pass each player last got candidates in
+
+    static bool tracked(GameObject* object) {
+        return object->m_objectType != GameObjectType::Decoration;
+    }
+
+    void build(GJBaseGameLayer* level);
+    void clear();
+
+    void add(GameObject* object);
+    void remove(GameObject* object);
+    void moved(GameObject* object);
+
+    void beginPass() { pass = ++passes; }
+    void endPass() { pass = 0; }
+    // true the first time a player asks within a pass. outside a pass
+    // every call gets its own query
+    bool serve(PlayerObject* player);
+
+    // every tracked object touching the player's box, grown by kPad and by
+    // how far the player moved since its last query. the cells narrow it
+    // down, the rect kernel tests what is left against the current rects
+    std::vector<GameObject*>& query(PlayerObject* player);
+
+private:
+    static int64_t key(int x, int y) {
+        return (static_cast<int64_t>(x) << 32) | static_cast<uint32_t>(y);
+    }
+
+    static CellRange rangeOf(cocos2d::CCRect const& rect);
+    void link(Entry& entry);
+    void unlink(Entry& entry);
+};
+
+extern CollisionGrid g_collisionGrid;
@@ -0,0 +1,219 @@
+// batched rect overlap tests
+
+#include "collision_kernel.hpp"
+#include "simd.hpp"
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+namespace {
+
+#if defined(PERFIX_AVX2)
+constexpr unsigned kLanes = 8;
+
+// bit n set if rect i + n touches the box
+inline unsigned overlapMask(RectSoA const& s, unsigned i, __m256 const (&box)[4]) {
+    __m256 m = _mm256_and_ps(
+        _mm256_and_ps(_mm256_cmp_ps(_mm256_loadu_ps(&s.minX[i]), box[2], _CMP_LE_OQ),
+                      _mm256_cmp_ps(_mm256_loadu_ps(&s.maxX[i]), box[0], _CMP_GE_OQ)),
+        _mm256_and_ps(_mm256_cmp_ps(_mm256_loadu_ps(&s.minY[i]), box[3], _CMP_LE_OQ),
+                      _mm256_cmp_ps(_mm256_loadu_ps(&s.maxY[i]), box[1], _CMP_GE_OQ)));
+    return static_cast<unsigned>(_mm256_movemask_ps(m));
+}
+
+inline void loadBox(__m256 (&out)[4], float minX, float minY, float maxX, float maxY) {
+    out[0] = _mm256_set1_ps(minX);
+    out[1] = _mm256_set1_ps(minY);
+    out[2] = _mm256_set1_ps(maxX);
+    out[3] = _mm256_set1_ps(maxY);
+}
+using vbox = __m256[4];
+#elif defined(PERFIX_SSE2)
+constexpr unsigned kLanes = 4;
+
+inline unsigned overlapMask(RectSoA const& s, unsigned i, __m128 const (&box)[4]) {
+    __m128 m = _mm_and_ps(
+        _mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(&s.minX[i]), box[2]),
+                   _mm_cmpge_ps(_mm_loadu_ps(&s.maxX[i]), box[0])),
+        _mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(&s.minY[i]), box[3]),
+                   _mm_cmpge_ps(_mm_loadu_ps(&s.maxY[i]), box[1])));
+    return static_cast<unsigned>(_mm_movemask_ps(m));
+}
+
+inline void loadBox(__m128 (&out)[4], float minX, float minY, float maxX, float maxY) {
+    out[0] = _mm_set1_ps(minX);
+    out[1] = _mm_set1_ps(minY);
+    out[2] = _mm_set1_ps(maxX);
+    out[3] = _mm_set1_ps(maxY);
+}
+using vbox = __m128[4];
+#elif defined(PERFIX_NEON_CMP)
+// only compares and masks, so armv7 neon runs the vector path too
+constexpr unsigned kLanes = 4;
+
+inline unsigned overlapMask(RectSoA const& s, unsigned i, float32x4_t const (&box)[4]) {
+    uint32x4_t m = vandq_u32(
+        vandq_u32(vcleq_f32(vld1q_f32(&s.minX[i]), box[2]), vcgeq_f32(vld1q_f32(&s.maxX[i]), box[0])),
+        vandq_u32(vcleq_f32(vld1q_f32(&s.minY[i]), box[3]), vcgeq_f32(vld1q_f32(&s.maxY[i]), box[1])));
+    // no movemask on neon, give each lane its own bit and fold them together
+    static uint32_t const kBits[4] = {1, 2, 4, 8};
+    uint32x4_t bits = vandq_u32(m, vld1q_u32(kBits));
+    uint32x2_t pair = vorr_u32(vget_low_u32(bits), vget_high_u32(bits));
+    return vget_lane_u32(pair, 0) | vget_lane_u32(pair, 1);
+}
+
+inline void loadBox(float32x4_t (&out)[4], float minX, float minY, float maxX, float maxY) {
+    out[0] = vdupq_n_f32(minX);
+    out[1] = vdupq_n_f32(minY);
+    out[2] = vdupq_n_f32(maxX);
+    out[3] = vdupq_n_f32(maxY);
+}
+using vbox = float32x4_t[4];
+#endif
+
+// plain per-rect test for whatever doesn't fill a vector group, the whole
+// array on targets without one
+unsigned overlapScalar(RectSoA const& s, unsigned begin, unsigned end, float minX, float minY, float maxX,
+                       float maxY, std::vector<uint32_t>& hits) {
+    unsigned added = 0;
+    for (unsigned i = begin; i < end; i++) {
+        if (s.minX[i] <= maxX && s.maxX[i] >= minX && s.minY[i] <= maxY && s.maxY[i] >= minY) {
+            hits.push_back(i);
+            added++;
+        }
+    }
+    return added;
+}
+
+} // namespace
+
+void RectSoA::clear() {
+    minX.clear();
+    minY.clear();
+    maxX.clear();
+    maxY.clear();
+}
+
+void RectSoA::push(CCRect const& rect) {
+    minX.push_back(rect.getMinX());
+    minY.push_back(rect.getMinY());
+    maxX.push_back(rect.getMaxX());
+    maxY.push_back(rect.getMaxY());
+}
+
+unsigned overlapRects(RectSoA const& rects, CCRect const& box, std::vector<uint32_t>& hits) {
+    float minX = box.getMinX();
+    float minY = box.getMinY();
+    float maxX = box.getMaxX();
+    float maxY = box.getMaxY();
+    unsigned count = static_cast<unsigned>(rects.size());
+    unsigned i = 0;
+    unsigned added = 0;
+
+#if defined(PERFIX_AVX2) || defined(PERFIX_SSE2) || defined(PERFIX_NEON_CMP)
+    vbox vb;
+    loadBox(vb, minX, minY, maxX, maxY);
+    for (; i + kLanes <= count; i += kLanes) {
+        // most groups miss entirely near the player, only hits cost a push
+        unsigned mask = overlapMask(rects, i, vb);
+        while (mask) {
+            unsigned lane = static_cast<unsigned>(std::countr_zero(mask));
+            hits.push_back(i + lane);
+            added++;
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    return added + overlapScalar(rects, i, count, minX, minY, maxX, maxY, hits);
+}
+
+char const* collisionKernelName() {
+#if defined(PERFIX_AVX2)
+    return "AVX2";
+#elif defined(PERFIX_SSE2)
+    return "SSE2";
+#elif defined(PERFIX_NEON_CMP)
+    return "NEON";
+#else
+    return "scalar";
+#endif
+}
+
+// synthetic layouts: block rows like a built level, objects spread over a
+// level's area, and clumps of deco-heavy spots
+static std::vector<CCRect> benchmarkLayout(int layout, unsigned count, std::mt19937& rng) {
+    std::vector<CCRect> rects;
+    rects.reserve(count);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    float width = count * 8.0f;
+
+    for (unsigned i = 0; i < count; i++) {
+        switch (layout) {
+            case 0: {
+                float x = (i / 4) * 30.0f;
+                float y = (i % 4) * 30.0f + (unit(rng) < 0.3f ? 90.0f : 0.0f);
+                rects.emplace_back(x, y, 30.0f, 30.0f);
+                break;
+            }
+            case 1: {
+                float size = 10.0f + unit(rng) * 50.0f;
+                rects.emplace_back(unit(rng) * width, unit(rng) * 600.0f, size, size);
+                break;
+            }
+            default: {
+                std::normal_distribution<float> spread(0.0f, 60.0f);
+                float cx = std::floor(unit(rng) * 16.0f) * width / 16.0f;
+                rects.emplace_back(cx + spread(rng), 150.0f + spread(rng), 30.0f, 30.0f);
+                break;
+            }
+        }
+    }
+    return rects;
+}
+
+void benchmarkCollisionKernel() {
+    using Clock = std::chrono::steady_clock;
+    static char const* const kLayouts[] = {"blocks", "uniform", "clustered"};
+    constexpr int kQueries = 2000;
+
+    std::mt19937 rng(1234);
+    for (int layout = 0; layout < 3; layout++) {
+        for (unsigned count : {64u, 512u, 4096u}) {
+            auto rects = benchmarkLayout(layout, count, rng);
+            RectSoA soa;
+            for (auto& rect : rects) soa.push(rect);
+
+            // a player sized box swept along the level
+            float width = count * 8.0f;
+            std::vector<CCRect> boxes;
+            for (int q = 0; q < kQueries; q++) {
+                boxes.emplace_back(width * q / kQueries - 30.0f, 60.0f, 90.0f, 90.0f);
+            }
+
+            size_t scalarHits = 0;
+            auto start = Clock::now();
+            for (auto& box : boxes) {
+                for (auto& rect : rects) scalarHits += rect.intersectsRect(box);
+            }
+            double scalarMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+            size_t vectorHits = 0;
+            std::vector<uint32_t> hits;
+            start = Clock::now();
+            for (auto& box : boxes) {
+                hits.clear();
+                vectorHits += overlapRects(soa, box, hits);
+            }
+            double vectorMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+            double tests = static_cast<double>(count) * kQueries;
+            log::info("perfix: rect kernel {} {} n={}: scalar {:.2f}ns, {:.2f}ns per test ({:.1f}x){}",
+                collisionKernelName(), kLayouts[layout], count,
+                scalarMs * 1e6 / tests, vectorMs * 1e6 / tests,
+                vectorMs > 0.0 ? scalarMs / vectorMs : 0.0,
+                scalarHits == vectorHits ? "" : " HIT MISMATCH");
+        }
+    }
+}
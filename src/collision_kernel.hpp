@@ -0,0 +1,27 @@
+#pragma once
+
+// batched rect overlap tests for the collision broad phase (SSE2 / AVX2 / NEON)
+
+#include <Geode/Geode.hpp>
+#include <vector>
+
+using namespace geode::prelude;
+
+// candidate rects packed one array per edge
+struct RectSoA {
+    std::vector<float> minX, minY, maxX, maxY;
+
+    void clear();
+    void push(cocos2d::CCRect const& rect);
+    size_t size() const { return minX.size(); }
+};
+
+// appends the index of every rect touching box to hits, same edges count
+// as CCRect::intersectsRect. returns how many were added
+unsigned overlapRects(RectSoA const& rects, cocos2d::CCRect const& box, std::vector<uint32_t>& hits);
+
+// instruction set overlapRects was built for, shown next to the grid stats
+char const* collisionKernelName();
+
+// times the kernel against the scalar loop on synthetic layouts and logs it
+void benchmarkCollisionKernel();
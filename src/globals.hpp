@@ -1,8 +1,13 @@
 #pragma once
 
 #include <Geode/Geode.hpp>
+#include <algorithm>
+#include <array>
 #include <chrono>
+#include <cmath>
 #include <deque>
+#include <unordered_map>
+#include <unordered_set>
 
 using namespace geode::prelude;
 
@@ -55,6 +60,19 @@ struct UltraProfiler {
     int particlesSkipped = 0;
     int particleUpdateCalls = 0;
     int particleAddCalls = 0;
+    int particlesCulled = 0;
+    int particlesLive = 0;
+    int particleBudget = 0;
+    int particlesDenied = 0;
+    int particlesSleeping = 0;
+    int particlesDisabled = 0;
+    double kernelParticleMs = 0.0;
+    double scalarParticleMs = 0.0;
+    int kernelParticles = 0;
+    int scalarParticles = 0;
+    int kernelRejected = 0;
+    int parallelSystems = 0;       // systems stepped on the worker pool
+    double parallelParticleMs = 0.0; // game thread time spent in the batch
 
     // effects
     int pulseEffectsActive = 0;
@@ -66,6 +84,20 @@ struct UltraProfiler {
 
     // optimization counters
     int glowsDisabled = 0;
+    int glowsHidden = 0;       // late objects and the player, by setGlowColor
+    int glowBytesUndrawn = 0;
+    int glowsLit = 0;
+    int glowsActive = 0;
+    int highDetailStripped = 0;
+    int tinyObjectsCulled = 0;
+    int aggressiveDeferred = 0;
+    double aggressiveSavedMs = 0.0;
+    int collisionsSkipped = 0;
+    double collisionSavedMs = 0.0;
+    double collisionLatencyMs = 0.0;  // worst deferred hit, kept across resets
+    int collisionOffered = 0;         // objects gd's sections handed the collision pass
+    int collisionTests = 0;           // objects the pass actually tested
+    int collisionGridObjects = 0;
     int highDetailSkipped = 0;
     int trailSnapshotsSkipped = 0;
     int shakesSkipped = 0;
@@ -80,6 +112,8 @@ struct UltraProfiler {
     // rendering
     int batchNodeCount = 0;
     int estimatedDrawCalls = 0;
+    int particleDrawCalls = 0;
+    int particleDrawsUnbatched = 0;
     int textureBindEstimate = 0;
     bool shadersActive = false;
     int shaderEffectsActive = 0;
@@ -100,6 +134,23 @@ struct UltraProfiler {
     int sfxTriggersProcessed = 0;
     int audioTriggersActive = 0;
 
+    // spawn limiter, per group
+    struct SpawnCounters {
+        int executed = 0;
+        int deferred = 0;
+    };
+    std::unordered_map<int, SpawnCounters> spawnsByGroup;
+    int spawnsExecuted = 0;
+    int spawnsDeferred = 0;
+
+    // spawn graph
+    int spawnLoops = 0;
+    int spawnFanOuts = 0;
+    int spawnsCoalesced = 0;
+    double spawnMs = 0.0;           // root spawns, nested work included
+    double spawnCoalescedMs = 0.0;  // estimated work the coalescer saved
+    std::string lastSpawnLoop;      // kept across resets, last one seen
+
     void reset() {
         wallFrameTotal = wallFrameMax = 0.0;
         wallFrameMin = 999.0;
@@ -111,12 +162,21 @@ struct UltraProfiler {
         collisionMs = cameraMs = moveActionsMs = rotationActionsMs = 0.0;
         transformActionsMs = areaActionsMs = audioMs = postUpdateMs = 0.0;
 
-        particlesSkipped = glowsDisabled = highDetailSkipped = 0;
+        particlesSkipped = glowsDisabled = glowsHidden = highDetailSkipped = 0;
+        collisionsSkipped = collisionOffered = collisionTests = 0;
+        collisionSavedMs = 0.0;
         trailSnapshotsSkipped = shakesSkipped = 0;
         triggersActivated = pulseTriggers = shakeTriggers = 0;
         moveTriggers = spawnTriggers = 0;
-        particleUpdateCalls = particleAddCalls = 0;
+        particleUpdateCalls = particleAddCalls = particlesCulled = 0;
+        particlesDenied = kernelParticles = scalarParticles = kernelRejected = 0;
+        kernelParticleMs = scalarParticleMs = parallelParticleMs = 0.0;
+        parallelSystems = 0;
         sfxTriggersProcessed = 0;
+        spawnsByGroup.clear();
+        spawnsExecuted = spawnsDeferred = 0;
+        spawnLoops = spawnFanOuts = spawnsCoalesced = 0;
+        spawnMs = spawnCoalescedMs = 0.0;
         frameSpikes = frameSevereSpikes = 0;
     }
 };
@@ -136,12 +196,30 @@ struct SettingsCache {
     bool disableHighDetail = false;
     bool disableMoveEffects = false;
     bool reducedParticles = false;
+    bool cullOffscreenParticles = false;
+    int particleCullMargin = 60;
+    bool limitParticles = false;
+    int particleBudget = 2000;
+    bool simdParticles = false;
+    bool parallelParticles = false;
+    bool sleepDormantParticles = false;
+    float particleQuality = 1.0f;
+    bool batchParticles = false;
+    bool glowLod = false;
+    int glowLodCount = 150;
+    int glowLodRadius = 0;
+    bool learnObjectCosts = false;
+    int objectLod = 0;  // ObjectLod
+    bool cullTinyObjects = false;
+    int tinyObjectSize = 3;
     bool expThrottleActions = false;
     bool expSkipAreaEffects = false;
     bool expThrottleTransforms = false;
     bool expThrottleSpawns = false;
     bool expReduceCollisions = false;
+    bool expCollisionGrid = false;
     bool expAggressiveCulling = false;
+    int aggressiveCullMargin = 40;
     bool expSkipFollowActions = false;
     bool expReduceColorUpdates = false;
     bool expThrottleGradients = false;
@@ -151,25 +229,737 @@ struct SettingsCache {
     bool expThrottlePlayerFollow = false;
     bool expLimitEnterEffects = false;
     bool expThrottleLabels = false;
+    int actionsHz = 30;
+    int gradientsHz = 20;
+    int advancedFollowHz = 30;
+    int dynamicObjectsHz = 30;
+    int playerFollowHz = 30;
+    int enterEffectsHz = 30;
+    int waveTrailHz = 30;
+    int labelsHz = 12;
+    int particlesHz = 30;
+    int collisionsHz = 30;
+    int colorEffectsHz = 30;
+    int spawnRate = 30;
+    int spawnBurst = 4;
+    int spawnQueueLimit = 512;
+    bool expCoalesceSpawns = false;
     bool cacheValid = false;
 };
 
 extern SettingsCache g_settings;
 
+// throttled subsystems, each one owns a slot in the scheduler
+enum class Throttled {
+    MoveActions,
+    RotationActions,
+    Gradients,
+    AdvancedFollow,
+    DynamicObjects,
+    PlayerFollow,
+    EnterEffects,
+    WaveTrail,
+    Labels,
+    Particles,
+    Collisions,
+    ColorEffects,
+    Count
+};
+
+constexpr size_t kThrottledCount = static_cast<size_t>(Throttled::Count);
+
+struct ThrottleSlot {
+    double period = 0.0;    // seconds between runs, from the target rate
+    double accum = 0.0;     // time since the slot last ran, offset by phase
+    int divisor = 1;        // frames per run at the measured refresh rate
+    int phase = 0;
+    bool active = false;
+    bool due = true;
+    double costMs = 0.0;    // smoothed cost of a frame the slot ran on
+    double frameMs = 0.0;   // cost accumulated during the current frame
+    float skippedDt = 0.0f; // dt of skipped calls, paid out on the next run
+};
+
+// dt banked by one instance of a per-instance throttled subsystem, dropped
+// when the throttle carry is reset
+struct ThrottleCarry {
+    float skippedDt = 0.0f;
+    unsigned generation = 0;
+};
+
 // throttle state
+// slots run at a target rate in Hz driven by accumulated time. phases are
+// picked so the measured cost is spread over frames instead of stacking on one
 struct ThrottleState {
     int frameCount = 0;
-    int lastSpawnFrame = 0;
+    std::array<ThrottleSlot, kThrottledCount> slots{};
+    double worstFrameMs = 0.0;  // heaviest frame of the current assignment
+    double frameDt = 0.0;       // smoothed frame time in seconds
+    bool rebalancePending = true;
+    std::array<int, kThrottledCount> configuredHz{};  // per slot, 0 while off
+    std::unordered_map<int, float> groupSkippedDt;
+    unsigned tickedFrame = 0;   // director frame of the last tick
+    unsigned carryGeneration = 0;
+
+    ThrottleSlot& slot(Throttled id) { return slots[static_cast<size_t>(id)]; }
+
+    bool shouldRun(Throttled id) const {
+        return slots[static_cast<size_t>(id)].due;
+    }
+
+    void record(Throttled id, double ms) {
+        slot(id).frameMs += ms;
+    }
+
+    // for dt driven subsystems: a skipped call banks its dt and the next call
+    // that runs gets the sum, so throttled objects still end up on time
+    bool consume(Throttled id, float& dt) {
+        auto& s = slot(id);
+        if (!s.due) {
+            s.skippedDt += dt;
+            return false;
+        }
+        dt += s.skippedDt;
+        s.skippedDt = 0.0f;
+        return true;
+    }
+
+    // same, banked by the caller for subsystems that run once per instance
+    bool consume(Throttled id, ThrottleCarry& carry, float& dt) {
+        if (carry.generation != carryGeneration) {
+            carry.skippedDt = 0.0f;
+            carry.generation = carryGeneration;
+        }
+        if (!shouldRun(id)) {
+            carry.skippedDt += dt;
+            return false;
+        }
+        dt += carry.skippedDt;
+        carry.skippedDt = 0.0f;
+        return true;
+    }
+
+    // same, banked per group for the per-group dynamic object actions
+    bool consumeGroup(Throttled id, int groupID, float& dt) {
+        if (!shouldRun(id)) {
+            groupSkippedDt[groupID] += dt;
+            return false;
+        }
+        auto it = groupSkippedDt.find(groupID);
+        if (it != groupSkippedDt.end()) {
+            dt += it->second;
+            groupSkippedDt.erase(it);
+        }
+        return true;
+    }
+
+    void resetCarry() {
+        for (auto& s : slots) s.skippedDt = 0.0f;
+        groupSkippedDt.clear();
+        carryGeneration++;
+    }
+
+    // a game layer ticked this frame or the one before
+    bool ticking() const {
+        return cocos2d::CCDirector::sharedDirector()->getTotalFrames() - tickedFrame <= 1;
+    }
+
+    // nothing ticks outside a level, every slot runs every frame
+    void idle() {
+        for (auto& s : slots) s.due = true;
+    }
+
+    // from the settings refresh, asks for a rebalance only if a throttle
+    // setting or rate actually changed
+    void configure();
+
+    // once per frame from the game layer update, rebalance runs from here too
+    void tick(float dt);
+    void rebalance();
 };
 
 extern ThrottleState g_throttle;
 
+// true if any throttle setting is on, so there is banked dt to drop
+bool throttlesWanted();
+
+// spawn limiter
+// one token bucket per spawned group. spawns over budget are postponed with
+// their original arguments instead of being dropped
+struct DeferredSpawn {
+    int group = 0;
+    bool ordered = false;
+    double delay = 0.0;
+    gd::vector<int> remapKeys;
+    int triggerID = 0;
+    int controlID = 0;
+
+    bool operator==(DeferredSpawn const& other) const {
+        return group == other.group && ordered == other.ordered && delay == other.delay &&
+               triggerID == other.triggerID && controlID == other.controlID &&
+               remapKeys.size() == other.remapKeys.size() &&
+               std::equal(remapKeys.begin(), remapKeys.end(), other.remapKeys.begin());
+    }
+};
+
+enum class DeferResult {
+    Queued,
+    Coalesced,  // an identical spawn is already pending
+    Full,
+};
+
+struct SpawnBucket {
+    double tokens = 0.0;
+    double stamp = 0.0;
+};
+
+struct SpawnLimiter {
+    double clock = 0.0;     // game time, advanced by the layer update
+    std::unordered_map<int, SpawnBucket> buckets;
+    std::unordered_map<int, int> pending;   // queued spawns per group
+    std::deque<DeferredSpawn> queue;
+
+    // true if an identical spawn is still waiting in the queue
+    bool queued(DeferredSpawn const& spawn) const {
+        if (!pending.contains(spawn.group)) return false;
+        return std::find(queue.begin(), queue.end(), spawn) != queue.end();
+    }
+
+    // a group with spawns already queued waits its turn, keeping order
+    bool take(int group) {
+        auto [it, inserted] = buckets.try_emplace(group);
+        auto& bucket = it->second;
+        if (inserted) {
+            bucket.tokens = g_settings.spawnBurst;
+        } else {
+            bucket.tokens = std::min<double>(g_settings.spawnBurst,
+                bucket.tokens + (clock - bucket.stamp) * g_settings.spawnRate);
+        }
+        bucket.stamp = clock;
+
+        if (bucket.tokens < 1.0) return false;
+        auto queued = pending.find(group);
+        if (queued != pending.end() && queued->second > 0) return false;
+        bucket.tokens -= 1.0;
+        return true;
+    }
+
+    // on Full the caller runs the spawn right away
+    DeferResult defer(DeferredSpawn spawn) {
+        if (g_settings.expCoalesceSpawns && queued(spawn)) return DeferResult::Coalesced;
+        if (static_cast<int>(queue.size()) >= g_settings.spawnQueueLimit) return DeferResult::Full;
+        pending[spawn.group]++;
+        queue.push_back(std::move(spawn));
+        return DeferResult::Queued;
+    }
+
+    void clear() {
+        clock = 0.0;
+        buckets.clear();
+        pending.clear();
+        queue.clear();
+    }
+};
+
+extern SpawnLimiter g_spawns;
+
+// spawn graph
+// live parent -> child edges between groups, built from spawns that run
+// while another spawn is still on the stack (zero delay chains)
+struct SpawnEdge {
+    int triggerID = 0;
+    int count = 0;
+};
+
+struct SpawnGraph {
+    static constexpr int kFanOutLimit = 64;
+
+    std::vector<int> stack;     // groups being spawned right now
+    std::unordered_map<uint64_t, SpawnEdge> edges;  // this frame
+    std::unordered_map<int, int> fanOut;            // spawns per parent, this frame
+    std::unordered_set<int> flaggedFanOut;
+
+    static uint64_t key(int parent, int child) {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(parent)) << 32) | static_cast<uint32_t>(child);
+    }
+
+    bool onStack(int group) const {
+        return std::find(stack.begin(), stack.end(), group) != stack.end();
+    }
+
+    // true the first time a parent crosses the fan-out limit this frame
+    bool link(int parent, int child, int triggerID) {
+        auto& edge = edges[key(parent, child)];
+        edge.triggerID = triggerID;
+        edge.count++;
+        return ++fanOut[parent] > kFanOutLimit && flaggedFanOut.insert(parent).second;
+    }
+
+    // "g12 > g40 (t85) > g12 (t91)" for a spawn of group closing a loop
+    std::string describeLoop(int group, int triggerID) const {
+        auto it = std::find(stack.begin(), stack.end(), group);
+        std::string out = fmt::format("g{}", *it);
+        for (auto next = it + 1; next != stack.end(); ++next) {
+            auto edge = edges.find(key(*(next - 1), *next));
+            out += fmt::format(" > g{} (t{})", *next, edge != edges.end() ? edge->second.triggerID : 0);
+        }
+        out += fmt::format(" > g{} (t{})", group, triggerID);
+        return out;
+    }
+
+    void beginFrame() {
+        edges.clear();
+        fanOut.clear();
+        flaggedFanOut.clear();
+    }
+};
+
+extern SpawnGraph g_spawnGraph;
+
+// particle budget
+// one live particle cap shared by every system. classes are served in
+// priority order, each gets what the classes above it didn't claim
+enum class ParticleClass {
+    Player,
+    OnScreen,
+    OffScreen,
+    Count
+};
+
+constexpr size_t kParticleClassCount = static_cast<size_t>(ParticleClass::Count);
+
+struct ParticleBudget {
+    int generation = 1;     // bumped when counts can't be trusted anymore
+    bool wasEnabled = false;
+    std::array<int, kParticleClassCount> live{};
+    std::array<int, kParticleClassCount> allowance{};
+    std::array<int, kParticleClassCount> denied{};       // this frame
+    std::array<int, kParticleClassCount> deniedLast{};
+    std::array<int, kParticleClassCount> systems{};      // this frame
+    std::array<int, kParticleClassCount> systemsLast{};
+
+    int totalLive() const {
+        int total = 0;
+        for (int n : live) total += n;
+        return total;
+    }
+
+    // demand is what a class holds plus what it was refused last frame
+    void beginFrame() {
+        if (!g_settings.limitParticles) {
+            wasEnabled = false;
+            return;
+        }
+        if (!wasEnabled) {
+            // systems stopped reporting while we were off
+            generation++;
+            live.fill(0);
+            wasEnabled = true;
+        }
+
+        deniedLast = denied;
+        systemsLast = systems;
+        denied.fill(0);
+        systems.fill(0);
+
+        int left = g_settings.particleBudget;
+        for (size_t i = 0; i < kParticleClassCount; i++) {
+            allowance[i] = left;
+            left = std::max(0, left - (live[i] + deniedLast[i]));
+        }
+    }
+
+    // under pressure every system of a class is held to an equal share
+    bool allow(ParticleClass cls, int systemLive) const {
+        auto i = static_cast<size_t>(cls);
+        if (live[i] >= allowance[i]) return false;
+        if (deniedLast[i] == 0) return true;
+        return systemLive < allowance[i] / std::max(1, systemsLast[i]);
+    }
+};
+
+extern ParticleBudget g_particleBudget;
+
+// dormant particle systems
+// no live particles and the emitter off. they come off the scheduler until
+// something restarts them, each one held by a reference meanwhile
+struct ParticleSleep {
+    std::unordered_set<cocos2d::CCParticleSystem*> sleepers;
+
+    void sleep(cocos2d::CCParticleSystem* system) {
+        // onEnter may have scheduled a sleeper again, it just goes back down
+        if (sleepers.insert(system).second) system->retain();
+        system->unscheduleUpdate();
+    }
+
+    void wake(cocos2d::CCParticleSystem* system) {
+        if (!sleepers.erase(system)) return;
+        system->scheduleUpdateWithPriority(1);  // what CCParticleSystem::onEnter uses
+        system->release();
+    }
+
+    // catches emitters turned back on behind our back, and lets go of
+    // systems nobody else holds anymore
+    void sweep() {
+        for (auto it = sleepers.begin(); it != sleepers.end();) {
+            auto* system = *it;
+            if (system->retainCount() == 1) {
+                it = sleepers.erase(it);
+                system->release();
+            } else if (system->getParticleCount() > 0 || system->isActive()) {
+                it = sleepers.erase(it);
+                system->scheduleUpdateWithPriority(1);
+                system->release();
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    void wakeAll() {
+        while (!sleepers.empty()) wake(*sleepers.begin());
+    }
+};
+
+extern ParticleSleep g_particleSleep;
+
+// particle systems switched off by disable particles, with the visibility
+// to give back when the setting is turned off again
+struct ParticleDisable {
+    std::unordered_map<cocos2d::CCParticleSystem*, bool> systems;
+
+    void disable(cocos2d::CCParticleSystem* system) {
+        auto [it, added] = systems.try_emplace(system, system->isVisible());
+        if (added) system->retain();
+        // one set per system, each prune counts on holding the only extra ref
+        if (g_particleSleep.sleepers.erase(system)) system->release();
+        system->unscheduleUpdate();
+        system->setVisible(false);
+    }
+
+    void restoreAll() {
+        for (auto [system, visible] : systems) {
+            system->setVisible(visible);
+            if (system->isRunning()) system->scheduleUpdateWithPriority(1);
+            system->release();
+        }
+        systems.clear();
+    }
+
+    // systems that left the scene for good only have our reference left
+    void prune() {
+        for (auto it = systems.begin(); it != systems.end();) {
+            if (it->first->retainCount() == 1) {
+                it->first->release();
+                it = systems.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+};
+
+extern ParticleDisable g_particleDisable;
+
+// glow sprites taken off a level's objects by disable glow, kept with the
+// node they sat in so they can go back if the setting is turned off
+struct GlowStrip {
+    struct Entry {
+        Ref<GameObject> object;
+        Ref<cocos2d::CCSprite> sprite;
+        Ref<cocos2d::CCNode> parent;
+        int zOrder = 0;
+    };
+
+    GJBaseGameLayer* layer = nullptr;  // level the glow was taken from
+    std::vector<Entry> stripped;
+
+    void strip(GJBaseGameLayer* level);
+
+    // hands every sprite back to its object, reattach puts it in the scene too
+    void restore(bool reattach);
+
+    // quad data the batch nodes no longer upload each frame. the sprites
+    // stay retained here for restore, so this is not memory freed
+    size_t quadBytesUndrawn() const {
+        return stripped.size() * sizeof(cocos2d::ccV3F_C4B_T2F_Quad);
+    }
+};
+
+extern GlowStrip g_glowStrip;
+
+// glow lod: of the active objects with glow, only the ones nearest the
+// player keep it lit. objects join and leave as they activate
+struct GlowLod {
+    GJBaseGameLayer* layer = nullptr;  // level the sets belong to
+    std::unordered_set<GameObject*> active;
+    std::unordered_set<GameObject*> lit;
+    float selectAccum = 0.0f;
+
+    // only objects of the running level join, the editor's never do
+    void activate(GameObject* object);
+    void deactivate(GameObject* object);
+
+    // re-picks the lit set a few times a second
+    void update(GJBaseGameLayer* level, float dt);
+
+    // relights everything and forgets the level
+    void restore();
+
+    // drops the sets of a level that may already be gone, touches nothing
+    void forget() {
+        active.clear();
+        lit.clear();
+        selectAccum = 0.0f;
+        layer = nullptr;
+    }
+};
+
+extern GlowLod g_glowLod;
+
+// objects pulled out of a level's section arrays, so the visibility pass
+// never walks them. addToSection puts them back when the setting goes off
+struct SectionStrip {
+    GJBaseGameLayer* layer = nullptr;  // level the objects were taken from
+    std::vector<Ref<GameObject>> removed;
+
+    template <class Predicate>
+    void strip(GJBaseGameLayer* level, Predicate&& wanted) {
+        if (layer != level) removed.clear();
+        layer = level;
+        if (!level->m_objects) return;
+
+        for (auto* object : CCArrayExt<GameObject*>(level->m_objects)) {
+            if (!wanted(object)) continue;
+            // an active object would stay on screen with nothing to retire it
+            if (object->getParent()) object->deactivateObject(true);
+            level->removeObjectFromSection(object);
+            removed.emplace_back(object);
+        }
+    }
+
+    void restore(bool readd);
+};
+
+extern SectionStrip g_highDetailStrip;
+extern SectionStrip g_lodStrip;  // types dropped by the object lod tier
+
+// decoration too small on screen to be worth activating at the current
+// zoom. a culled object has to grow to 1.5x the threshold to come back,
+// so zooming around the threshold doesn't flicker
+struct ScreenSizeCull {
+    float layerScale = 1.0f;  // object layer zoom, set before each visibility pass
+    std::unordered_set<GameObject*> culled;
+
+    bool tooSmall(GameObject* object) {
+        if (object->m_objectType != GameObjectType::Decoration) return false;
+
+        auto size = object->getScaledContentSize();
+        float pixels = std::max(std::abs(size.width), std::abs(size.height)) * layerScale;
+        float threshold = static_cast<float>(g_settings.tinyObjectSize);
+
+        if (culled.contains(object)) {
+            if (pixels < threshold * 1.5f) return true;
+            culled.erase(object);
+            return false;
+        }
+        if (pixels >= threshold) return false;
+        culled.insert(object);
+        return true;
+    }
+};
+
+extern ScreenSizeCull g_screenCull;
+
+// aggressive culling: objects only activate once they come within the
+// margin of the real screen rect, projected through the object layer's
+// zoom and rotation, instead of GD's wide fixed section margins. objects
+// already active stay until GD's own bounds drop them, so this postpones
+// activations, it doesn't shrink the section range
+struct AggressiveCull {
+    cocos2d::CCAffineTransform toScreen = cocos2d::CCAffineTransformMakeIdentity();
+    float scale = 1.0f;
+    cocos2d::CCRect view;      // screen rect grown by the margin
+    bool ready = false;
+    // distinct objects held back this overlay window. GD asks again every
+    // frame, but without us each would have activated once
+    std::unordered_set<GameObject*> held;
+    double activateMs = 0.0;   // running average of real activations
+
+    void begin(cocos2d::CCNode* objectLayer) {
+        toScreen = objectLayer->nodeToWorldTransform();
+        scale = std::max(std::hypot(toScreen.a, toScreen.b), std::hypot(toScreen.c, toScreen.d));
+
+        float margin = static_cast<float>(g_settings.aggressiveCullMargin);
+        auto win = cocos2d::CCDirector::sharedDirector()->getWinSize();
+        view = cocos2d::CCRect(-margin, -margin, win.width + margin * 2.0f, win.height + margin * 2.0f);
+        ready = true;
+    }
+
+    // bounding circle against the view, rotation can't make it miss
+    bool outside(GameObject* object) const {
+        if (!ready) return false;
+        auto size = object->getScaledContentSize();
+        float radius = 0.5f * std::hypot(size.width, size.height) * scale;
+        auto center = cocos2d::CCPointApplyAffineTransform(object->getPosition(), toScreen);
+        return center.x + radius < view.getMinX() || center.x - radius > view.getMaxX() ||
+               center.y + radius < view.getMinY() || center.y - radius > view.getMaxY();
+    }
+
+    void sampleActivation(double ms) {
+        activateMs = activateMs == 0.0 ? ms : activateMs + (ms - activateMs) * 0.05;
+    }
+
+    void clear() {
+        ready = false;
+        held.clear();
+    }
+};
+
+extern AggressiveCull g_aggressiveCull;
+
+// reduced collision checks. hazards and solids are checked every call,
+// everything else only on the collisions slot's frames unless it lies in
+// the box the player can sweep before the next full check
+struct CollisionFilter {
+    struct Track {
+        cocos2d::CCPoint position;
+        cocos2d::CCPoint step;  // movement over the last frame
+        int frame = -1;
+    };
+
+    int frame = -1;
+    bool due = true;
+    int framesSinceFull = 0;
+    int heldFrames = 0;                        // frames behind the set being checked
+    std::unordered_map<PlayerObject*, Track> tracks;
+    std::unordered_set<GameObject*> heldBack;  // since the last full check
+    std::unordered_set<GameObject*> checking;  // held back before this full check
+    gd::vector<GameObject*> kept;              // per section scratch, handed to gd as is
+    double perObjectMs = 0.0;  // running average cost of one object in the check
+
+    static bool critical(GameObject* object) {
+        switch (object->m_objectType) {
+            case GameObjectType::Solid:
+            case GameObjectType::Hazard:
+            case GameObjectType::AnimatedHazard:
+            case GameObjectType::Slope:
+            case GameObjectType::Breakable:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    void beginFrame(int frameCount, bool slotDue) {
+        if (frame == frameCount) return;
+        frame = frameCount;
+        due = slotDue;
+        if (due) {
+            checking = std::move(heldBack);
+            heldBack.clear();
+            heldFrames = framesSinceFull;
+            framesSinceFull = 0;
+        } else {
+            framesSinceFull++;
+        }
+    }
+
+    // the player's box grown by how far it can move before the next full
+    // check. movement is measured per frame, physics substeps call this
+    // several times with smaller steps in between. doubled for speed changes
+    cocos2d::CCRect sweptBounds(PlayerObject* player, int divisor) {
+        auto& track = tracks[player];
+        auto pos = player->getPosition();
+        if (track.frame != frame) {
+            if (track.frame >= 0) track.step = ccpSub(pos, track.position);
+            track.position = pos;
+            track.frame = frame;
+        }
+        float reach = (std::abs(track.step.x) + std::abs(track.step.y)) * (divisor + 1) * 2.0f + 30.0f;
+
+        auto rect = player->getObjectRect();
+        return cocos2d::CCRect(rect.origin.x - reach, rect.origin.y - reach,
+                               rect.size.width + reach * 2.0f, rect.size.height + reach * 2.0f);
+    }
+
+    void clear() {
+        tracks.clear();
+        heldBack.clear();
+        checking.clear();
+        frame = -1;
+        framesSinceFull = 0;
+    }
+};
+
+extern CollisionFilter g_collisionFilter;
+
+// color and alpha triggers still running, counted from their durations.
+// the clock is effect time so pauses don't end them
+struct EffectTracker {
+    double now = 0.0;
+    std::vector<double> colorEnds;
+    std::vector<double> opacityEnds;
+
+    void started(std::vector<double>& ends, float duration) {
+        ends.push_back(now + std::max(0.0f, duration));
+    }
+
+    int running(std::vector<double>& ends) {
+        std::erase_if(ends, [this](double end) { return end < now; });
+        return static_cast<int>(ends.size());
+    }
+
+    void clear() {
+        now = 0.0;
+        colorEnds.clear();
+        opacityEnds.clear();
+    }
+};
+
+extern EffectTracker g_effects;
+
 void refreshSettings();
 
+// hook toggles
+// every hook is bound to the settings that need it. syncHooks() enables or
+// disables the geode hook handle, so an unused hook costs nothing at all.
+// a hook can be bound more than once, it stays on while any binding wants
+// it and each onDisable runs when its own binding stops wanting it
+using HookPredicate = bool (*)();
+
+struct HookBinding {
+    Hook* hook = nullptr;
+    HookPredicate wanted = nullptr;
+    void (*onDisable)() = nullptr;
+    bool active = false;
+};
+
+std::vector<HookBinding>& hookBindings();
+void syncHooks();
+
+// call from onModify, name is the geode display name ("Class::method")
+template <class Modify>
+void bindHook(Modify& self, char const* name, HookPredicate wanted, void (*onDisable)() = nullptr) {
+    auto res = self.getHook(name);
+    if (res.isErr()) {
+        log::warn("perfix: could not bind hook {}", name);
+        return;
+    }
+    auto* hook = res.unwrap();
+    hook->setAutoEnable(false);
+    hookBindings().push_back({hook, wanted, onDisable});
+}
+
+inline bool profilerWanted() {
+    return g_settings.showProfiler;
+}
+
 // timing macros
 #define PROFILE_START auto _prof_start = std::chrono::steady_clock::now()
 #define PROFILE_END(var) var = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _prof_start).count()
 #define PROFILE_ADD(var) var += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _prof_start).count()
+#define PROFILE_ELAPSED std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _prof_start).count()
 
 inline void profilerSimFrame(float dt) {
     double ms = dt * 1000.0;
@@ -1,9 +1,35 @@
 // core gameplay hooks
 
 #include "globals.hpp"
+#include "collision_grid.hpp"
+#include "collision_kernel.hpp"
+#include "object_costs.hpp"
+#include "particle_batch.hpp"
+#include "particle_kernel.hpp"
+#include "worker_pool.hpp"
 #include <Geode/modify/GJBaseGameLayer.hpp>
 #include <Geode/modify/PlayLayer.hpp>
 #include <Geode/modify/ShaderLayer.hpp>
+#include <algorithm>
+
+// busiest deferred groups for the detailed panel
+static void appendSpawnGroups(std::string& out) {
+    std::vector<std::pair<int, UltraProfiler::SpawnCounters>> groups(
+        g_prof.spawnsByGroup.begin(), g_prof.spawnsByGroup.end());
+    std::erase_if(groups, [](auto const& g) { return g.second.deferred == 0; });
+    if (groups.empty()) return;
+
+    size_t shown = std::min<size_t>(groups.size(), 4);
+    std::partial_sort(groups.begin(), groups.begin() + shown, groups.end(), [](auto const& a, auto const& b) {
+        return a.second.deferred > b.second.deferred;
+    });
+
+    out += "\n\nDeferred spawns";
+    for (size_t i = 0; i < shown; i++) {
+        out += fmt::format("\n  g{}: {} run / {} def", groups[i].first,
+            groups[i].second.executed, groups[i].second.deferred);
+    }
+}
 
 class $modify(PerfixBaseGameLayer, GJBaseGameLayer) {
     struct Fields {
@@ -11,10 +37,91 @@ class $modify(PerfixBaseGameLayer, GJBaseGameLayer) {
         CCLabelBMFont* profilerLabel = nullptr;
         CCLabelBMFont* detailedLabel = nullptr;
         float settingsRefreshAccum = 0.0f;
+        bool started = false;
     };
 
+    // update drives settings refresh and the overlay, so it stays installed
+    static void onModify(auto& self) {
+        bindHook(self, "GJBaseGameLayer::updateShaderLayer",
+            [] { return g_settings.disableShaders; },
+            [] {
+                // hook is gone, so nothing will unhide the layer for us
+                auto* layer = GJBaseGameLayer::get();
+                if (layer && layer->m_shaderLayer) layer->m_shaderLayer->setVisible(true);
+            });
+        bindHook(self, "GJBaseGameLayer::processMoveActions",
+            [] { return profilerWanted() || g_settings.expThrottleActions; });
+        bindHook(self, "GJBaseGameLayer::processRotationActions",
+            [] { return profilerWanted() || g_settings.expThrottleActions; });
+        bindHook(self, "GJBaseGameLayer::processTransformActions",
+            [] { return profilerWanted() || g_settings.expThrottleTransforms; });
+        bindHook(self, "GJBaseGameLayer::processAreaActions",
+            [] { return profilerWanted() || g_settings.expSkipAreaEffects; });
+        bindHook(self, "GJBaseGameLayer::processFollowActions",
+            [] { return profilerWanted() || g_settings.expSkipFollowActions; });
+        bindHook(self, "GJBaseGameLayer::spawnGroup",
+            [] { return profilerWanted() || g_settings.expThrottleSpawns || g_settings.expCoalesceSpawns; });
+        bindHook(self, "GJBaseGameLayer::updateGradientLayers",
+            [] { return g_settings.expThrottleGradients; });
+        bindHook(self, "GJBaseGameLayer::processAdvancedFollowActions",
+            [] { return g_settings.expThrottleAdvancedFollow; });
+        bindHook(self, "GJBaseGameLayer::processDynamicObjectActions",
+            [] { return g_settings.expThrottleDynamicObjects; });
+        bindHook(self, "GJBaseGameLayer::processPlayerFollowActions",
+            [] { return g_settings.expThrottlePlayerFollow; });
+        bindHook(self, "GJBaseGameLayer::updateEnterEffects",
+            [] { return g_settings.expLimitEnterEffects; });
+        bindHook(self, "GJBaseGameLayer::collisionCheckObjects",
+            [] { return g_settings.expReduceCollisions; }, [] { g_collisionFilter.clear(); });
+        bindHook(self, "GJBaseGameLayer::collisionCheckObjects",
+            [] { return profilerWanted() || g_settings.expCollisionGrid; }, [] { g_collisionGrid.clear(); });
+        bindHook(self, "GJBaseGameLayer::addToSection",
+            [] { return g_settings.expCollisionGrid; });
+        bindHook(self, "GJBaseGameLayer::removeObjectFromSection",
+            [] { return g_settings.expCollisionGrid; });
+    }
+
     void update(float dt) {
-        g_throttle.frameCount++;
+        if (!m_fields->started) {
+            // banked dt and queued spawns belong to the previous level
+            g_throttle.resetCarry();
+            g_spawns.clear();
+            g_particleDisable.prune();
+            g_collisionFilter.clear();
+            g_effects.clear();
+            // strips of a level that left without onQuit, never touch it
+            if (g_glowStrip.layer != this) g_glowStrip.restore(false);
+            if (g_highDetailStrip.layer != this) g_highDetailStrip.restore(false);
+            if (g_lodStrip.layer != this) g_lodStrip.restore(false);
+            if (g_glowLod.layer != this) g_glowLod.forget();
+            g_screenCull.culled.clear();
+            g_aggressiveCull.clear();
+            g_objectCosts.leaveLevel();
+            m_fields->started = true;
+        }
+        if (g_settings.disableGlow && g_glowStrip.layer != this &&
+            PlayLayer::get() == static_cast<GJBaseGameLayer*>(this)) {
+            g_glowStrip.strip(this);
+        }
+        if (g_settings.disableHighDetail && g_highDetailStrip.layer != this &&
+            PlayLayer::get() == static_cast<GJBaseGameLayer*>(this)) {
+            g_highDetailStrip.strip(this, [](GameObject* object) { return object->m_isHighDetail; });
+        }
+        if (g_settings.objectLod > 0 && g_lodStrip.layer != this &&
+            PlayLayer::get() == static_cast<GJBaseGameLayer*>(this)) {
+            auto& dropped = g_objectCosts.lodDropped;
+            dropped = g_objectCosts.dropped(static_cast<ObjectLod>(g_settings.objectLod));
+            g_lodStrip.strip(this, [&](GameObject* object) { return dropped.contains(object->m_objectID); });
+        }
+        if (g_settings.expCollisionGrid && g_collisionGrid.layer != this &&
+            PlayLayer::get() == static_cast<GJBaseGameLayer*>(this)) {
+            g_collisionGrid.build(this);
+        }
+        if (g_settings.glowLod && PlayLayer::get() == static_cast<GJBaseGameLayer*>(this)) {
+            g_glowLod.update(this, dt);
+        }
+        if (g_settings.learnObjectCosts) g_objectCosts.endFrame();
+        g_throttle.tick(dt);
 
         // refresh settings periodically
         m_fields->settingsRefreshAccum += dt;
@@ -31,6 +138,15 @@ class $modify(PerfixBaseGameLayer, GJBaseGameLayer) {
             profilerWallFrame();
         }
 
+        g_spawns.clock += dt;
+        g_spawnGraph.beginFrame();
+        g_particleBudget.beginFrame();
+        g_particleSleep.sweep();
+        g_particleBatcher.beginFrame();
+        if (g_settings.batchParticles) g_particleBatcher.sweepHidden();
+        g_particleBatcher.flush();
+        drainDeferredSpawns();
+
         PROFILE_START;
         GJBaseGameLayer::update(dt);
         PROFILE_END(g_prof.updateMs);
@@ -40,13 +156,30 @@ class $modify(PerfixBaseGameLayer, GJBaseGameLayer) {
         g_prof.visibleObjects1 = m_visibleObjectsCount;
         g_prof.visibleObjects2 = m_visibleObjects2Count;
         g_prof.activeGradients = m_activeGradients;
+        g_prof.collisionGridObjects = static_cast<int>(g_collisionGrid.entries.size());
+        g_prof.colorActionsActive = g_effects.running(g_effects.colorEnds);
+        g_prof.opacityEffectsActive = g_effects.running(g_effects.opacityEnds);
         g_prof.shadersActive = (m_shaderLayer != nullptr);
         g_prof.leftSection = m_leftSectionIndex;
         g_prof.rightSection = m_rightSectionIndex;
         g_prof.topSection = m_topSectionIndex;
         g_prof.bottomSection = m_bottomSectionIndex;
         g_prof.batchNodeCount = m_batchNodes ? m_batchNodes->count() : 0;
-        g_prof.estimatedDrawCalls = g_prof.batchNodeCount + g_prof.particleSystemCount +
+        g_prof.particlesLive = g_particleBudget.totalLive();
+        g_prof.particlesSleeping = static_cast<int>(g_particleSleep.sleepers.size());
+        g_prof.particlesDisabled = static_cast<int>(g_particleDisable.systems.size());
+        g_prof.particleBudget = g_settings.limitParticles ? g_settings.particleBudget : 0;
+        g_prof.glowsDisabled = static_cast<int>(g_glowStrip.stripped.size());
+        g_prof.glowBytesUndrawn = static_cast<int>(g_glowStrip.quadBytesUndrawn());
+        g_prof.glowsLit = static_cast<int>(g_glowLod.lit.size());
+        g_prof.glowsActive = static_cast<int>(g_glowLod.active.size());
+        g_prof.highDetailStripped = static_cast<int>(g_highDetailStrip.removed.size());
+        g_prof.tinyObjectsCulled = static_cast<int>(g_screenCull.culled.size());
+        g_prof.aggressiveDeferred = static_cast<int>(g_aggressiveCull.held.size());
+        g_prof.aggressiveSavedMs = g_prof.aggressiveDeferred * g_aggressiveCull.activateMs;
+        g_prof.particleDrawCalls = g_particleBatcher.drawsLast;
+        g_prof.particleDrawsUnbatched = g_particleBatcher.unbatchedDrawsLast;
+        g_prof.estimatedDrawCalls = g_prof.batchNodeCount + g_prof.particleDrawCalls +
                                     (g_prof.shadersActive ? 5 : 0) + g_prof.activeGradients;
 
         if (!g_prof.enabled) return;
@@ -76,6 +209,7 @@ class $modify(PerfixBaseGameLayer, GJBaseGameLayer) {
         double avgSim = g_prof.simFrameCount > 0 ? (g_prof.simFrameTotal / g_prof.simFrameCount) : 0.0;
         double fpsWall = avgWall > 0.0 ? (1000.0 / avgWall) : 0.0;
         double fpsSim = avgSim > 0.0 ? (1000.0 / avgSim) : 0.0;
+        int frames = std::max(g_prof.simFrameCount, 1);
 
         std::string status = "";
         if (g_prof.frameSevereSpikes > 0) status = " [!!!]";
@@ -107,11 +241,20 @@ class $modify(PerfixBaseGameLayer, GJBaseGameLayer) {
             "\n"
             "Rendering\n"
             "BatchNodes: %d | DrawCalls: ~%d\n"
-            "Gradients: %d | Particles: %d\n"
+            "Particle draws: %d (unbatched %d)\n"
+            "Gradients: %d | Particles: %d (culled %d, asleep %d, off %d)\n"
+            "Particle budget: %d/%d live | denied %d\n"
             "\n"
             "Optimizations\n"
             "Skip: P%d G%d H%d T%d\n"
-            "Triggers: %d (S%d P%d M%d)",
+            "Stripped: glow %d (%.1f KB of quads not drawn) | high-detail %d\n"
+            "Glow LOD: lit %d/%d | Tiny culled: %d\n"
+            "Activations deferred: %d objects (~%.2fms)\n"
+            "Collisions held: %d (~%.2fms) | late hit max %.0fms\n"
+            "Collision tests/frame: %d of %d offered | grid %d (%s)\n"
+            "Triggers: %d (S%d P%d M%d) | running color %d alpha %d\n"
+            "Spawns: run %d | deferred %d | queued %d\n"
+            "Spawn loops: %d | fan-out: %d | coalesced %d (~%.2fms)",
             status.c_str(),
             fpsWall, fpsSim, grade,
             avgWall, g_prof.wallFrameMin, g_prof.wallFrameMax,
@@ -123,9 +266,21 @@ class $modify(PerfixBaseGameLayer, GJBaseGameLayer) {
             g_prof.visibilityMs, g_prof.collisionMs,
             g_prof.cameraMs, g_prof.moveActionsMs + g_prof.rotationActionsMs,
             g_prof.batchNodeCount, g_prof.estimatedDrawCalls,
-            g_prof.activeGradients, g_prof.particleSystemCount,
-            g_prof.particlesSkipped, g_prof.glowsDisabled, g_prof.highDetailSkipped, g_prof.trailSnapshotsSkipped,
-            g_prof.triggersActivated, g_prof.spawnTriggers, g_prof.pulseTriggers, g_prof.moveTriggers
+            g_prof.particleDrawCalls, g_prof.particleDrawsUnbatched,
+            g_prof.activeGradients, g_prof.particleSystemCount, g_prof.particlesCulled, g_prof.particlesSleeping,
+            g_prof.particlesDisabled,
+            g_prof.particlesLive, g_prof.particleBudget, g_prof.particlesDenied,
+            g_prof.particlesSkipped, g_prof.glowsHidden, g_prof.highDetailSkipped, g_prof.trailSnapshotsSkipped,
+            g_prof.glowsDisabled, g_prof.glowBytesUndrawn / 1024.0, g_prof.highDetailStripped,
+            g_prof.glowsLit, g_prof.glowsActive, g_prof.tinyObjectsCulled,
+            g_prof.aggressiveDeferred, g_prof.aggressiveSavedMs,
+            g_prof.collisionsSkipped, g_prof.collisionSavedMs, g_prof.collisionLatencyMs,
+            g_prof.collisionTests / frames, g_prof.collisionOffered / frames, g_prof.collisionGridObjects,
+            collisionKernelName(),
+            g_prof.triggersActivated, g_prof.spawnTriggers, g_prof.pulseTriggers, g_prof.moveTriggers,
+            g_prof.colorActionsActive, g_prof.opacityEffectsActive,
+            g_prof.spawnsExecuted, g_prof.spawnsDeferred, static_cast<int>(g_spawns.queue.size()),
+            g_prof.spawnLoops, g_prof.spawnFanOuts, g_prof.spawnsCoalesced, g_prof.spawnCoalescedMs
         );
 
         m_fields->profilerLabel->setString(buf);
@@ -166,7 +321,10 @@ class $modify(PerfixBaseGameLayer, GJBaseGameLayer) {
                 "Other\n"
                 "  visibility: %.2fms\n"
                 "  collision: %.2fms\n"
-                "  camera: %.2fms",
+                "  camera: %.2fms\n"
+                "\n"
+                "Scheduler\n"
+                "  worst slot: %.2fms",
                 pct(g_prof.shaderVisitMs),
                 pct(g_prof.effectMs),
                 g_prof.pulseEffectMs, g_prof.opacityEffectMs,
@@ -174,16 +332,40 @@ class $modify(PerfixBaseGameLayer, GJBaseGameLayer) {
                 g_prof.moveActionsMs, g_prof.rotationActionsMs,
                 g_prof.transformActionsMs, g_prof.areaActionsMs,
                 pct(g_prof.particleMs),
-                g_prof.visibilityMs, g_prof.collisionMs, g_prof.cameraMs
+                g_prof.visibilityMs, g_prof.collisionMs, g_prof.cameraMs,
+                g_throttle.worstFrameMs
             );
 
-            m_fields->detailedLabel->setString(detailBuf);
+            std::string detail = detailBuf;
+            appendSpawnGroups(detail);
+            if (g_settings.simdParticles || g_settings.parallelParticles) {
+                auto rate = [](int particles, double ms) { return ms > 0.0 ? particles / ms : 0.0; };
+                detail += fmt::format("\n\nParticle kernel ({})\n  kernel: {:.0f} p/ms\n  scalar: {:.0f} p/ms\n  rejected: {}",
+                    particleKernelName(),
+                    rate(g_prof.kernelParticles, g_prof.kernelParticleMs),
+                    rate(g_prof.scalarParticles, g_prof.scalarParticleMs),
+                    g_prof.kernelRejected);
+            }
+            if (g_settings.parallelParticles) {
+                detail += fmt::format("\n  parallel: {} systems, {:.2f}ms on {} workers",
+                    g_prof.parallelSystems, g_prof.parallelParticleMs,
+                    WorkerPool::get().workerCount());
+            }
+            if (g_settings.learnObjectCosts || g_settings.objectLod > 0) {
+                detail += fmt::format("\n\nObject costs\n  learned: {} types\n  lod dropped: {} objects",
+                    g_objectCosts.costs.size(), g_lodStrip.removed.size());
+            }
+            if (!g_prof.lastSpawnLoop.empty()) {
+                detail += "\n\nLast spawn loop\n  " + g_prof.lastSpawnLoop;
+            }
+            m_fields->detailedLabel->setString(detail.c_str());
             m_fields->detailedLabel->setVisible(true);
         } else if (m_fields->detailedLabel) {
             m_fields->detailedLabel->setVisible(false);
         }
 
         g_prof.reset();
+        g_aggressiveCull.held.clear();
     }
 
     void updateShaderLayer(float dt) {
@@ -196,17 +378,21 @@ class $modify(PerfixBaseGameLayer, GJBaseGameLayer) {
     }
 
     void processMoveActions() {
-        if (g_settings.expThrottleActions && (g_throttle.frameCount % 2 == 0)) return;
+        if (!g_throttle.shouldRun(Throttled::MoveActions)) return;
         PROFILE_START;
         GJBaseGameLayer::processMoveActions();
-        PROFILE_ADD(g_prof.moveActionsMs);
+        double ms = PROFILE_ELAPSED;
+        g_prof.moveActionsMs += ms;
+        g_throttle.record(Throttled::MoveActions, ms);
     }
 
     void processRotationActions() {
-        if (g_settings.expThrottleActions && (g_throttle.frameCount % 2 == 0)) return;
+        if (!g_throttle.shouldRun(Throttled::RotationActions)) return;
         PROFILE_START;
         GJBaseGameLayer::processRotationActions();
-        PROFILE_ADD(g_prof.rotationActionsMs);
+        double ms = PROFILE_ELAPSED;
+        g_prof.rotationActionsMs += ms;
+        g_throttle.record(Throttled::RotationActions, ms);
     }
 
     void processTransformActions(bool visibleFrame) {
@@ -232,40 +418,285 @@ class $modify(PerfixBaseGameLayer, GJBaseGameLayer) {
 
     void spawnGroup(int group, bool ordered, double delay, gd::vector<int> const& remapKeys, int triggerID, int controlID) {
         g_prof.spawnTriggers++;
-        if (g_settings.expThrottleSpawns) {
-            if (g_throttle.frameCount - g_throttle.lastSpawnFrame < 2) return;
-            g_throttle.lastSpawnFrame = g_throttle.frameCount;
+
+        auto& graph = g_spawnGraph;
+        if (!graph.stack.empty()) {
+            if (graph.link(graph.stack.back(), group, triggerID)) {
+                g_prof.spawnFanOuts++;
+            }
+            if (graph.onStack(group)) {
+                g_prof.spawnLoops++;
+                g_prof.lastSpawnLoop = graph.describeLoop(group, triggerID);
+                // break the zero delay cycle: the re-spawn waits for the next
+                // tick, where an identical one already queued absorbs it
+                if (g_settings.expCoalesceSpawns && deferSpawn({group, ordered, delay, remapKeys, triggerID, controlID})) {
+                    return;
+                }
+            }
+        }
+
+        if (g_settings.expThrottleSpawns && !g_spawns.take(group)) {
+            if (deferSpawn({group, ordered, delay, remapKeys, triggerID, controlID})) return;
         }
+        runSpawn(group, ordered, delay, remapKeys, triggerID, controlID);
+    }
+
+    static void countCoalesced() {
+        g_prof.spawnsCoalesced++;
+        if (g_prof.spawnsExecuted > 0) {
+            g_prof.spawnCoalescedMs += g_prof.spawnMs / g_prof.spawnsExecuted;
+        }
+    }
+
+    // false when the queue is full and the spawn has to run now
+    bool deferSpawn(DeferredSpawn spawn) {
+        int group = spawn.group;
+        switch (g_spawns.defer(std::move(spawn))) {
+            case DeferResult::Queued:
+                g_prof.spawnsByGroup[group].deferred++;
+                g_prof.spawnsDeferred++;
+                return true;
+            case DeferResult::Coalesced:
+                countCoalesced();
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    void runSpawn(int group, bool ordered, double delay, gd::vector<int> const& remapKeys, int triggerID, int controlID) {
+        g_prof.spawnsByGroup[group].executed++;
+        g_prof.spawnsExecuted++;
+
+        auto& stack = g_spawnGraph.stack;
+        bool root = stack.empty();
+        stack.push_back(group);
+        PROFILE_START;
         GJBaseGameLayer::spawnGroup(group, ordered, delay, remapKeys, triggerID, controlID);
+        if (root) PROFILE_ADD(g_prof.spawnMs);
+        stack.pop_back();
+    }
+
+    // runs queued spawns whose group has budget again, oldest first. with the
+    // limiter switched off everything left is flushed
+    void drainDeferredSpawns() {
+        if (g_spawns.queue.empty()) return;
+
+        auto queued = std::move(g_spawns.queue);
+        g_spawns.queue.clear();
+        g_spawns.pending.clear();
+
+        for (auto& spawn : queued) {
+            if (g_settings.expThrottleSpawns && !g_spawns.take(spawn.group)) {
+                g_spawns.pending[spawn.group]++;
+                g_spawns.queue.push_back(std::move(spawn));
+                continue;
+            }
+            runSpawn(spawn.group, spawn.ordered, spawn.delay, spawn.remapKeys, spawn.triggerID, spawn.controlID);
+        }
     }
 
     void updateGradientLayers() {
-        if (g_settings.expThrottleGradients && (g_throttle.frameCount % 3 != 0)) return;
+        if (!g_throttle.shouldRun(Throttled::Gradients)) return;
+        PROFILE_START;
         GJBaseGameLayer::updateGradientLayers();
+        g_throttle.record(Throttled::Gradients, PROFILE_ELAPSED);
     }
 
     void processAdvancedFollowActions(float dt) {
-        if (g_settings.expThrottleAdvancedFollow && (g_throttle.frameCount % 2 == 0)) return;
+        if (!g_throttle.consume(Throttled::AdvancedFollow, dt)) return;
+        PROFILE_START;
         GJBaseGameLayer::processAdvancedFollowActions(dt);
+        g_throttle.record(Throttled::AdvancedFollow, PROFILE_ELAPSED);
     }
 
     void processDynamicObjectActions(int groupID, float dt) {
-        if (g_settings.expThrottleDynamicObjects && (g_throttle.frameCount % 2 == 0)) return;
+        if (!g_throttle.consumeGroup(Throttled::DynamicObjects, groupID, dt)) return;
+        PROFILE_START;
         GJBaseGameLayer::processDynamicObjectActions(groupID, dt);
+        g_throttle.record(Throttled::DynamicObjects, PROFILE_ELAPSED);
     }
 
     void processPlayerFollowActions(float dt) {
-        if (g_settings.expThrottlePlayerFollow && (g_throttle.frameCount % 2 == 0)) return;
+        if (!g_throttle.consume(Throttled::PlayerFollow, dt)) return;
+        PROFILE_START;
         GJBaseGameLayer::processPlayerFollowActions(dt);
+        g_throttle.record(Throttled::PlayerFollow, PROFILE_ELAPSED);
     }
 
     void updateEnterEffects(float dt) {
-        if (g_settings.expLimitEnterEffects && (g_throttle.frameCount % 2 == 0)) return;
+        if (!g_throttle.consume(Throttled::EnterEffects, dt)) return;
+        PROFILE_START;
         GJBaseGameLayer::updateEnterEffects(dt);
+        g_throttle.record(Throttled::EnterEffects, PROFILE_ELAPSED);
+    }
+
+    // the grid objects mirror what sits in the sections
+    void addToSection(GameObject* object) {
+        GJBaseGameLayer::addToSection(object);
+        if (g_collisionGrid.layer == this && CollisionGrid::tracked(object)) g_collisionGrid.add(object);
+    }
+
+    void removeObjectFromSection(GameObject* object) {
+        if (g_collisionGrid.layer == this) g_collisionGrid.remove(object);
+        GJBaseGameLayer::removeObjectFromSection(object);
+    }
+
+    // gd calls this once per section near the player. with the grid, the
+    // first call of a pass for a player tests every tracked object around it
+    // and the rest have nothing left to do
+    void collisionCheckObjects(PlayerObject* player, gd::vector<GameObject*>* objects, int count, float dt) {
+        g_prof.collisionOffered += std::max(count, 0);
+        if (g_settings.expCollisionGrid && player && g_collisionGrid.layer == this) {
+            if (!g_collisionGrid.serve(player)) return;
+            gd::vector<GameObject*> candidates(g_collisionGrid.query(player));
+            checkFiltered(player, &candidates, static_cast<int>(candidates.size()), dt);
+            return;
+        }
+        checkFiltered(player, objects, count, dt);
+    }
+
+    void checkFiltered(PlayerObject* player, gd::vector<GameObject*>* objects, int count, float dt) {
+        if (!g_settings.expReduceCollisions) {
+            g_prof.collisionTests += std::max(count, 0);
+            GJBaseGameLayer::collisionCheckObjects(player, objects, count, dt);
+            return;
+        }
+
+        auto& filter = g_collisionFilter;
+        filter.beginFrame(g_throttle.frameCount, g_throttle.shouldRun(Throttled::Collisions));
+        if (!player || !objects || count <= 0) {
+            g_prof.collisionTests += std::max(count, 0);
+            GJBaseGameLayer::collisionCheckObjects(player, objects, count, dt);
+            return;
+        }
+
+        if (filter.due) {
+            // a held back object the player touches now is a hit that came late
+            if (!filter.checking.empty()) {
+                auto rect = player->getObjectRect();
+                for (int i = 0; i < count; i++) {
+                    auto* object = (*objects)[i];
+                    if (object && filter.checking.contains(object) && rect.intersectsRect(object->getObjectRect())) {
+                        double late = filter.heldFrames * g_throttle.frameDt * 1000.0;
+                        g_prof.collisionLatencyMs = std::max(g_prof.collisionLatencyMs, late);
+                    }
+                }
+            }
+
+            g_prof.collisionTests += count;
+            PROFILE_START;
+            GJBaseGameLayer::collisionCheckObjects(player, objects, count, dt);
+            double ms = PROFILE_ELAPSED;
+            double perObject = ms / count;
+            filter.perObjectMs = filter.perObjectMs == 0.0 ? perObject : filter.perObjectMs + (perObject - filter.perObjectMs) * 0.05;
+            g_throttle.record(Throttled::Collisions, ms);
+            return;
+        }
+
+        auto swept = filter.sweptBounds(player, g_throttle.slot(Throttled::Collisions).divisor);
+        filter.kept.clear();
+        for (int i = 0; i < count; i++) {
+            auto* object = (*objects)[i];
+            if (!object || CollisionFilter::critical(object) || swept.intersectsRect(object->getObjectRect())) {
+                filter.kept.push_back(object);
+            } else {
+                filter.heldBack.insert(object);
+            }
+        }
+
+        int skipped = count - static_cast<int>(filter.kept.size());
+        if (skipped == 0) {
+            g_prof.collisionTests += count;
+            GJBaseGameLayer::collisionCheckObjects(player, objects, count, dt);
+            return;
+        }
+        g_prof.collisionsSkipped += skipped;
+        g_prof.collisionSavedMs += skipped * filter.perObjectMs;
+
+        int kept = static_cast<int>(filter.kept.size());
+        g_prof.collisionTests += kept;
+        GJBaseGameLayer::collisionCheckObjects(player, &filter.kept, kept, dt);
     }
 };
 
 class $modify(PerfixPlayLayer, PlayLayer) {
+    static void onModify(auto& self) {
+        bindHook(self, "PlayLayer::resetLevel",
+            [] { return g_settings.expThrottleSpawns || g_settings.expCoalesceSpawns || throttlesWanted(); });
+        bindHook(self, "PlayLayer::shakeCamera",
+            [] { return g_settings.disableShake; });
+        bindHook(self, "PlayLayer::updateVisibility",
+            [] {
+                return profilerWanted() || g_settings.disableParticles || g_settings.cullTinyObjects ||
+                       g_settings.expAggressiveCulling;
+            });
+        bindHook(self, "PlayLayer::postUpdate", profilerWanted);
+        bindHook(self, "PlayLayer::checkCollisions",
+            [] { return profilerWanted() || g_settings.expCollisionGrid; });
+        bindHook(self, "PlayLayer::updateCamera", profilerWanted);
+        bindHook(self, "PlayLayer::onQuit",
+            [] { return g_settings.disableGlow; }, restoreGlow);
+        bindHook(self, "PlayLayer::onQuit",
+            [] { return g_settings.glowLod; }, restoreGlowLod);
+        bindHook(self, "PlayLayer::onQuit",
+            [] { return g_settings.disableHighDetail; }, restoreHighDetail);
+        bindHook(self, "PlayLayer::onQuit",
+            [] { return g_settings.objectLod > 0; }, restoreObjectLod);
+        bindHook(self, "PlayLayer::onQuit",
+            [] { return g_settings.learnObjectCosts; }, saveObjectCosts);
+        bindHook(self, "PlayLayer::onQuit",
+            [] {
+                return g_settings.cullTinyObjects || g_settings.expAggressiveCulling ||
+                       g_settings.expReduceCollisions || g_settings.expCollisionGrid;
+            });
+    }
+
+    static void restoreObjectLod() {
+        g_lodStrip.restore(true);
+        g_objectCosts.lodDropped.clear();
+    }
+
+    static void saveObjectCosts() {
+        g_objectCosts.save();
+    }
+
+    static void restoreHighDetail() {
+        g_highDetailStrip.restore(true);
+    }
+
+    static void restoreGlow() {
+        g_glowStrip.restore(true);
+    }
+
+    static void restoreGlowLod() {
+        g_glowLod.restore();
+    }
+
+    // the objects get their glow back before they're torn down as usual
+    void onQuit() {
+        g_glowStrip.restore(false);
+        g_glowLod.restore();
+        g_highDetailStrip.restore(false);
+        g_lodStrip.restore(false);
+        g_objectCosts.lodDropped.clear();
+        g_screenCull.culled.clear();
+        g_aggressiveCull.clear();
+        g_collisionFilter.clear();
+        g_collisionGrid.clear();
+        if (g_settings.learnObjectCosts) g_objectCosts.save();
+        g_objectCosts.leaveLevel();
+        PlayLayer::onQuit();
+    }
+
+    void resetLevel() {
+        // queued spawns and banked dt from before the reset must not pay
+        // out after it, throttled groups would jump on their first run
+        g_spawns.clear();
+        g_throttle.resetCarry();
+        PlayLayer::resetLevel();
+    }
+
     void shakeCamera(float duration, float strength, float interval) {
         if (g_settings.disableShake) {
             g_prof.shakesSkipped++;
@@ -276,6 +707,8 @@ class $modify(PerfixPlayLayer, PlayLayer) {
 
     void updateVisibility(float dt) {
         if (g_settings.disableParticles) m_disableGravityEffect = true;
+        if (m_objectLayer) g_screenCull.layerScale = m_objectLayer->getScale();
+        if (g_settings.expAggressiveCulling && m_objectLayer) g_aggressiveCull.begin(m_objectLayer);
         PROFILE_START;
         PlayLayer::updateVisibility(dt);
         PROFILE_ADD(g_prof.visibilityMs);
@@ -288,9 +721,11 @@ class $modify(PerfixPlayLayer, PlayLayer) {
     }
 
     int checkCollisions(PlayerObject* player, float dt, bool p2) {
+        g_collisionGrid.beginPass();
         PROFILE_START;
         int result = PlayLayer::checkCollisions(player, dt, p2);
         PROFILE_ADD(g_prof.collisionMs);
+        g_collisionGrid.endPass();
         return result;
     }
 
@@ -302,6 +737,15 @@ class $modify(PerfixPlayLayer, PlayLayer) {
 };
 
 class $modify(PerfixShaderLayer, ShaderLayer) {
+    static void onModify(auto& self) {
+        bindHook(self, "ShaderLayer::visit",
+            [] { return profilerWanted() || g_settings.disableShaders; });
+        bindHook(self, "ShaderLayer::performCalculations",
+            [] { return profilerWanted() || g_settings.disableShaders; });
+        bindHook(self, "ShaderLayer::setupShader",
+            [] { return g_settings.disableShaders; });
+    }
+
     void visit() {
         if (g_settings.disableShaders) {
             g_prof.shaderVisitMs = 0.0;
@@ -1,8 +1,19 @@
 // visual effect hooks (particles, trails, objects, triggers)
 
 #include "globals.hpp"
+#include "collision_grid.hpp"
+#include "object_costs.hpp"
+#include "particle_batch.hpp"
+#include "particle_kernel.hpp"
+#include "worker_pool.hpp"
+#include <cmath>
+#include <numeric>
 #include <Geode/modify/GhostTrailEffect.hpp>
 #include <Geode/modify/CCParticleSystem.hpp>
+#include <Geode/modify/CCParticleSystemQuad.hpp>
+#include <Geode/modify/CCParticleBatchNode.hpp>
+#include <Geode/modify/CCScheduler.hpp>
+#include <Geode/modify/CCSpriteBatchNode.hpp>
 #include <Geode/modify/GameObject.hpp>
 #include <Geode/modify/GJEffectManager.hpp>
 #include <Geode/modify/EffectGameObject.hpp>
@@ -14,6 +25,11 @@
 // ghost trail
 
 class $modify(PerfixGhostTrailEffect, GhostTrailEffect) {
+    static void onModify(auto& self) {
+        bindHook(self, "GhostTrailEffect::trailSnapshot",
+            [] { return g_settings.disableTrails; });
+    }
+
     void trailSnapshot(float dt) {
         if (g_settings.disableTrails) {
             g_prof.trailSnapshotsSkipped++;
@@ -25,62 +41,800 @@ class $modify(PerfixGhostTrailEffect, GhostTrailEffect) {
 
 // particle system
 
+// parallel mode rides on the kernel, it needs a verified kernel to defer to
+static bool kernelWanted() {
+    return g_settings.simdParticles || g_settings.parallelParticles;
+}
+
+// a system whose simulation was deferred to the end of the frame
+struct ParticleJob {
+    CCParticleSystem* system = nullptr;
+    float dt = 0.0f;
+    CCPoint position = CCPointZero;
+    bool finished = false;  // emptied and wants removing
+};
+
+static std::vector<ParticleJob> g_particleJobs;
+
+// systems alive with a pool from a reduced quality tier
+static int g_reducedTierSystems = 0;
+
 class $modify(PerfixCCParticleSystem, cocos2d::CCParticleSystem) {
+    struct Fields {
+        float offscreenTime = 0.0f; // emitter continuously out of view
+        float culledTime = 0.0f;    // update time skipped by culling
+        float throttledTime = 0.0f; // update time skipped by reduced particles
+
+        // particle budget bookkeeping
+        ParticleClass budgetClass = ParticleClass::OffScreen;
+        int counted = 0;            // particles this system holds in the budget
+        int generation = 0;
+        bool classified = false;
+        bool playerOwned = false;
+
+        // quality tier the pool was allocated at
+        float quality = 1.0f;
+        bool qualityFitted = false;
+
+        // soa kernel, used once it reproduced the scalar update enough times
+        int kernelMatches = 0;
+        bool kernelRejected = false;
+
+        ~Fields() {
+            if (quality < 1.0f) g_reducedTierSystems--;
+            if (generation != g_particleBudget.generation) return;
+            g_particleBudget.live[static_cast<size_t>(budgetClass)] -= counted;
+        }
+    };
+
+    static void onModify(auto& self) {
+        bindHook(self, "cocos2d::CCParticleSystem::update",
+            [] {
+                return profilerWanted() || g_settings.disableParticles || g_settings.reducedParticles ||
+                       g_settings.cullOffscreenParticles || g_settings.limitParticles || kernelWanted() ||
+                       g_settings.sleepDormantParticles;
+            });
+        bindHook(self, "cocos2d::CCParticleSystem::addParticle",
+            [] { return profilerWanted() || g_settings.limitParticles; });
+        bindHook(self, "cocos2d::CCParticleSystem::onEnter",
+            [] { return g_settings.disableParticles; }, restoreParticles);
+        bindHook(self, "cocos2d::CCParticleSystem::onEnter", reducedTierWanted);
+        bindHook(self, "cocos2d::CCParticleSystem::onEnter",
+            [] { return g_settings.batchParticles; }, unbatchParticles);
+        bindHook(self, "cocos2d::CCParticleSystem::initWithTotalParticles", qualityWanted);
+        bindHook(self, "cocos2d::CCParticleSystem::resetSystem",
+            [] { return g_settings.sleepDormantParticles; }, wakeAllParticles);
+        bindHook(self, "cocos2d::CCParticleSystem::resumeSystem",
+            [] { return g_settings.sleepDormantParticles; }, wakeAllParticles);
+    }
+
     void update(float dt) {
         g_prof.particleUpdateCalls++;
         g_prof.particleSystemCount++;
 
+        // systems that were already running when the setting came on,
+        // each one only gets here once
         if (g_settings.disableParticles) {
-            g_prof.particlesSkipped++;
-            this->setVisible(false);
+            g_particleDisable.disable(this);
             return;
         }
 
-        if (g_settings.reducedParticles) {
-            if (g_throttle.frameCount % 2 == 0) {
-                g_prof.particlesSkipped++;
+        if (g_settings.limitParticles) reconcileBudget();
+
+        // nothing to draw and nothing coming, stop getting called until
+        // reset or resumed. only inside a level, where the sweep runs
+        if (g_settings.sleepDormantParticles && m_uParticleCount == 0 && !m_bIsActive &&
+            GJBaseGameLayer::get() && !g_particleDisable.systems.contains(this)) {
+            g_particleSleep.sleep(this);
+            return;
+        }
+
+        PROFILE_START;
+        if (g_settings.cullOffscreenParticles) {
+            if (shouldCull(dt)) {
+                m_fields->culledTime += dt;
+                g_prof.particlesCulled++;
+                return;
+            }
+            if (m_fields->culledTime > 0.0f && !fastForward()) {
+                PROFILE_ADD(g_prof.particleMs);
                 return;
             }
         }
 
+        // menus have no game layer ticking the scheduler, a slot left not
+        // due there would stop their systems for good
+        if (!g_throttle.ticking()) {
+            g_throttle.idle();
+            m_fields->throttledTime = 0.0f;
+        }
+
+        if (!g_throttle.shouldRun(Throttled::Particles)) {
+            g_prof.particlesSkipped++;
+            m_fields->throttledTime += dt;
+            extrapolate(m_fields->throttledTime);
+            PROFILE_ADD(g_prof.particleMs);
+            return;
+        }
+
+        dt += m_fields->throttledTime;
+        m_fields->throttledTime = 0.0f;
+        stepSystem(dt, true);
+        double ms = PROFILE_ELAPSED;
+        g_prof.particleMs += ms;
+        g_throttle.record(Throttled::Particles, ms);
+    }
+
+    static constexpr int kKernelVerifyFrames = 8;
+
+    // one simulation step, through the soa kernel once it has proven itself.
+    // deferrable steps can be left to the worker batch after emitting
+    void stepSystem(float dt, bool deferrable = false) {
+        unsigned count = m_uParticleCount;
+        bool kernel = kernelWanted() && !m_fields->kernelRejected &&
+                      m_fields->kernelMatches >= kKernelVerifyFrames;
+
+        if (!kernel && kernelWanted() && !m_fields->kernelRejected) {
+            // verification runs both paths, keep it out of the numbers
+            verifyKernel(dt);
+            return;
+        }
+
+        // batch node systems share an atlas with their siblings, they stay serial
+        if (kernel && deferrable && g_settings.parallelParticles && !m_pBatchNode) {
+            emitParticles(dt);
+            this->retain();
+            g_particleJobs.push_back({this, dt});
+            return;
+        }
+
         PROFILE_START;
+        if (kernel) {
+            kernelUpdate(dt);
+            g_prof.kernelParticleMs += PROFILE_ELAPSED;
+            g_prof.kernelParticles += count;
+        } else {
+            CCParticleSystem::update(dt);
+            g_prof.scalarParticleMs += PROFILE_ELAPSED;
+            g_prof.scalarParticles += count;
+        }
+    }
+
+    ParticleStep kernelStep(float dt) {
+        ParticleStep step;
+        step.dt = dt;
+        step.gravityMode = m_nEmitterMode == kCCParticleModeGravity;
+        if (step.gravityMode) {
+            step.gravityX = modeA.gravity.x;
+            step.gravityY = modeA.gravity.y;
+        }
+        return step;
+    }
+
+    // what emitParticles would leave behind, without adding anything
+    struct EmitPrediction {
+        float counter = 0.0f;
+        float elapsed = 0.0f;
+        bool active = false;
+        unsigned added = 0;
+    };
+
+    EmitPrediction predictEmission(float dt) {
+        EmitPrediction out{m_fEmitCounter, m_fElapsed, m_bIsActive, 0};
+        if (!m_bIsActive || !m_fEmissionRate) return out;
+
+        float rate = 1.0f / m_fEmissionRate;
+        unsigned count = m_uParticleCount;
+        if (count < m_uTotalParticles) out.counter += dt;
+        while (count < m_uTotalParticles && out.counter > rate) {
+            count++;
+            out.added++;
+            out.counter -= rate;
+        }
+        out.elapsed += dt;
+        if (m_fDuration != -1 && m_fDuration < out.elapsed) {
+            // stopSystem
+            out.active = false;
+            out.elapsed = m_fDuration;
+            out.counter = 0.0f;
+        }
+        return out;
+    }
+
+    // runs the real update and checks the kernel path would have produced
+    // the same thing: emission bookkeeping, the particle count, and every
+    // surviving particle in the slot the death swaps leave it in
+    void verifyKernel(float dt) {
+        unsigned count = m_uParticleCount;
+        if (!m_bVisible || count == 0) {
+            CCParticleSystem::update(dt);
+            return;
+        }
+
+        auto emit = predictEmission(dt);
+        auto step = kernelStep(dt);
+        auto& predicted = particleScratch();
+        predicted.load(m_pParticles, count, step.gravityMode);
+        integrateParticles(predicted, count, step);
+
         CCParticleSystem::update(dt);
-        PROFILE_ADD(g_prof.particleMs);
+
+        // a dead particle is replaced by the last one. replay that over the
+        // old slots and the emitted ones, which are assumed to outlive
+        // their first step
+        std::vector<unsigned> order(count + emit.added);
+        std::iota(order.begin(), order.end(), 0u);
+        unsigned alive = static_cast<unsigned>(order.size());
+        for (unsigned i = 0; i < alive;) {
+            if (order[i] >= count || predicted.ttl[order[i]] > 0.0f) {
+                i++;
+            } else {
+                order[i] = order[--alive];
+            }
+        }
+
+        bool emissionMatches = std::abs(m_fEmitCounter - emit.counter) <= 1e-4f &&
+                               std::abs(m_fElapsed - emit.elapsed) <= 1e-4f && m_bIsActive == emit.active;
+        if (emissionMatches && m_uParticleCount < alive) return;  // a new one died or was denied, no verdict
+
+        bool matches = emissionMatches && m_uParticleCount == alive;
+        for (unsigned i = 0; matches && i < alive; i++) {
+            if (order[i] < count) matches = predicted.matchesAt(order[i], m_pParticles[i], step.gravityMode);
+        }
+        if (matches) {
+            m_fields->kernelMatches++;
+        } else {
+            m_fields->kernelRejected = true;
+            g_prof.kernelRejected++;
+        }
+    }
+
+    // CCParticleSystem::update with the per-particle integration done by the
+    // kernel. emission, deaths and quads follow the cocos code line by line
+    void kernelUpdate(float dt) {
+        emitParticles(dt);
+        if (simulate(dt, emitterPosition())) {
+            this->unscheduleUpdate();
+            m_pParent->removeChild(this, true);
+            return;
+        }
+        if (!m_pBatchNode) postStep();
+    }
+
+    void emitParticles(float dt) {
+        if (m_bIsActive && m_fEmissionRate) {
+            float rate = 1.0f / m_fEmissionRate;
+            if (m_uParticleCount < m_uTotalParticles) m_fEmitCounter += dt;
+            while (m_uParticleCount < m_uTotalParticles && m_fEmitCounter > rate) {
+                this->addParticle();
+                m_fEmitCounter -= rate;
+            }
+            m_fElapsed += dt;
+            if (m_fDuration != -1 && m_fDuration < m_fElapsed) this->stopSystem();
+        }
+    }
+
+    // origin free and relative particles are drawn against. goes through the
+    // parents' cached transforms, so only the game thread may ask
+    CCPoint emitterPosition() {
+        if (m_ePositionType == kCCPositionTypeFree) return this->convertToWorldSpace(CCPointZero);
+        if (m_ePositionType == kCCPositionTypeRelative) return m_obPosition;
+        return CCPointZero;
+    }
+
+    // integration, deaths and quads. touches nothing outside this system
+    // unless it sits in a batch node, so workers can run it. true if the
+    // system emptied and wants to be removed
+    bool simulate(float dt, CCPoint const& currentPosition) {
+        m_uParticleIdx = 0;
+        if (!m_bVisible) return false;
+
+        auto step = kernelStep(dt);
+        auto& soa = particleScratch();
+        soa.load(m_pParticles, m_uParticleCount, step.gravityMode);
+        integrateParticles(soa, m_uParticleCount, step);
+        soa.store(m_pParticles, m_uParticleCount, step.gravityMode);
+
+        while (m_uParticleIdx < m_uParticleCount) {
+            tCCParticle* p = &m_pParticles[m_uParticleIdx];
+            if (p->timeToLive > 0) {
+                updateQuadWithParticle(p, drawPosition(*p, currentPosition));
+                ++m_uParticleIdx;
+            } else {
+                int currentIndex = p->atlasIndex;
+                if (m_uParticleIdx != m_uParticleCount - 1) {
+                    m_pParticles[m_uParticleIdx] = m_pParticles[m_uParticleCount - 1];
+                }
+                if (m_pBatchNode) {
+                    m_pBatchNode->disableParticle(m_uAtlasIndex + currentIndex);
+                    m_pParticles[m_uParticleCount - 1].atlasIndex = currentIndex;
+                }
+                --m_uParticleCount;
+                if (m_uParticleCount == 0 && m_bIsAutoRemoveOnFinish) return true;
+            }
+        }
+        m_bTransformSystemDirty = false;
+        return false;
+    }
+
+    CCPoint drawPosition(tCCParticle const& p, CCPoint const& currentPosition) {
+        CCPoint newPos = p.pos;
+        if (m_ePositionType == kCCPositionTypeFree || m_ePositionType == kCCPositionTypeRelative) {
+            newPos = ccpSub(p.pos, ccpSub(currentPosition, p.startPos));
+        }
+        if (m_pBatchNode) {
+            newPos.x += m_obPosition.x;
+            newPos.y += m_obPosition.y;
+        }
+        return newPos;
+    }
+
+    // in-between frame for reduced particles. redraws every particle where
+    // its velocity puts it after ahead seconds, the simulation stays put
+    // and catches up with the whole span on its next step
+    void extrapolate(float ahead) {
+        if (!m_bVisible || m_uParticleCount == 0) return;
+
+        CCPoint currentPosition = emitterPosition();
+        bool gravityMode = m_nEmitterMode == kCCParticleModeGravity;
+        // without a batch node the quad written is m_pQuads[m_uParticleIdx]
+        for (unsigned i = 0; i < m_uParticleCount; i++) {
+            m_uParticleIdx = i;
+            tCCParticle p = m_pParticles[i];
+            if (gravityMode) {
+                p.pos.x += p.modeA.dir.x * ahead;
+                p.pos.y += p.modeA.dir.y * ahead;
+            } else {
+                float angle = p.modeB.angle + p.modeB.degreesPerSecond * ahead;
+                float radius = p.modeB.radius + p.modeB.deltaRadius * ahead;
+                p.pos = ccp(-std::cos(angle) * radius, -std::sin(angle) * radius);
+            }
+            p.rotation += p.deltaRotation * ahead;
+            updateQuadWithParticle(&p, drawPosition(p, currentPosition));
+        }
+        m_uParticleIdx = m_uParticleCount;
+        if (!m_pBatchNode) postStep();
+    }
+
+    // how far a particle can get from the emitter over its life, node space
+    float particleReach() {
+        float life = m_fLife + m_fLifeVar;
+        float size = std::max(m_fStartSize + m_fStartSizeVar, m_fEndSize + m_fEndSizeVar);
+        float reach = std::max(std::abs(m_tPosVar.x), std::abs(m_tPosVar.y)) + size;
+        if (m_nEmitterMode == kCCParticleModeGravity) {
+            float accel = ccpLength(modeA.gravity) +
+                          std::abs(modeA.radialAccel) + std::abs(modeA.radialAccelVar) +
+                          std::abs(modeA.tangentialAccel) + std::abs(modeA.tangentialAccelVar);
+            reach += (std::abs(modeA.speed) + std::abs(modeA.speedVar)) * life + 0.5f * accel * life * life;
+        } else {
+            reach += std::max(modeB.startRadius + modeB.startRadiusVar, modeB.endRadius + modeB.endRadiusVar);
+        }
+        return reach;
+    }
+
+    bool emitterOffscreen() {
+        auto t = this->nodeToWorldTransform();
+        auto pos = CCPointApplyAffineTransform(m_tSourcePosition, t);
+        float scale = std::max(std::hypot(t.a, t.b), std::hypot(t.c, t.d));
+        float reach = particleReach() * scale + g_settings.particleCullMargin;
+        auto win = CCDirector::sharedDirector()->getWinSize();
+        return pos.x < -reach || pos.y < -reach || pos.x > win.width + reach || pos.y > win.height + reach;
+    }
+
+    bool shouldCull(float dt) {
+        if (!emitterOffscreen()) {
+            m_fields->offscreenTime = 0.0f;
+            return false;
+        }
+        m_fields->offscreenTime += dt;
+
+        // grouped particles move with the emitter. free and relative ones stay
+        // where they were emitted, so wait out anything emitted while in view
+        return m_ePositionType == kCCPositionTypeGrouped || m_uParticleCount == 0 ||
+               m_fields->offscreenTime >= m_fLife + m_fLifeVar;
+    }
+
+    // catch up on culled time in a few coarse steps. anything older than a
+    // particle lifetime can't be seen anymore, so only the emitter clock gets
+    // the rest. false if the system finished and removed itself
+    bool fastForward() {
+        float culled = m_fields->culledTime;
+        m_fields->culledTime = 0.0f;
+
+        float replay = std::min(culled, m_fLife + m_fLifeVar);
+        if (m_bIsActive) m_fElapsed += culled - replay;
+        if (replay <= 0.0f) return true;
+
+        int steps = std::clamp(static_cast<int>(std::ceil(replay * 20.0f)), 1, 6);
+        this->retain();
+        for (int i = 0; i < steps && m_pParent; i++) {
+            stepSystem(replay / steps);
+        }
+        bool alive = m_pParent != nullptr;
+        this->release();
+        return alive;
+    }
+
+    static bool ownedByPlayer(PlayerObject* player, CCParticleSystem* system) {
+        if (!player) return false;
+        return system->getParent() == player ||
+               system == player->m_playerGroundParticles || system == player->m_trailingParticles ||
+               system == player->m_shipClickParticles || system == player->m_vehicleGroundParticles ||
+               system == player->m_ufoClickParticles || system == player->m_robotBurstParticles ||
+               system == player->m_dashParticles;
+    }
+
+    ParticleClass budgetClass() {
+        if (!m_fields->classified) {
+            auto* layer = GJBaseGameLayer::get();
+            m_fields->playerOwned = layer &&
+                (ownedByPlayer(layer->m_player1, this) || ownedByPlayer(layer->m_player2, this));
+            m_fields->classified = true;
+        }
+        if (m_fields->playerOwned) return ParticleClass::Player;
+        return emitterOffscreen() ? ParticleClass::OffScreen : ParticleClass::OnScreen;
+    }
+
+    // move this system's particles to its current class and catch up on the
+    // ones that died since the last update
+    void reconcileBudget() {
+        auto& budget = g_particleBudget;
+        if (m_fields->generation != budget.generation) {
+            m_fields->generation = budget.generation;
+            m_fields->counted = 0;
+        }
+
+        auto cls = budgetClass();
+        budget.live[static_cast<size_t>(m_fields->budgetClass)] -= m_fields->counted;
+        m_fields->budgetClass = cls;
+        m_fields->counted = static_cast<int>(m_uParticleCount);
+        budget.live[static_cast<size_t>(cls)] += m_fields->counted;
+        budget.systems[static_cast<size_t>(cls)]++;
+    }
+
+    // onEnter schedules the update, take it right back off
+    void onEnter() {
+        CCParticleSystem::onEnter();
+        fitQuality();
+        if (g_settings.disableParticles) g_particleDisable.disable(this);
+
+        // entering a batch runs onEnter too
+        if (g_settings.batchParticles && !m_pBatchNode && !typeinfo_cast<CCParticleBatchNode*>(m_pParent)) {
+            g_particleBatcher.queue(this);
+        }
+    }
+
+    static void unbatchParticles() {
+        g_particleBatcher.unbatchAll();
+    }
+
+    static bool qualityWanted() {
+        return g_settings.particleQuality < 1.0f;
+    }
+
+    // systems from a reduced tier keep it after the setting goes back to 100%
+    static bool reducedTierWanted() {
+        return qualityWanted() || g_reducedTierSystems > 0;
+    }
+
+    // quality tiers shrink the pool before it's allocated. the quad
+    // subclass sizes its vertex buffer from the same count
+    bool initWithTotalParticles(unsigned int numberOfParticles) {
+        float quality = g_settings.particleQuality;
+        if (quality < 1.0f) {
+            numberOfParticles = std::max(1u, static_cast<unsigned>(numberOfParticles * quality));
+            if (m_fields->quality >= 1.0f) g_reducedTierSystems++;
+            m_fields->quality = quality;
+        }
+        return CCParticleSystem::initWithTotalParticles(numberOfParticles);
+    }
+
+    // emission is configured after the pool exists, so it's fitted once the
+    // system is set up and enters the scene. a rate the smaller pool can't
+    // sustain is scaled with the pool, the lifetime only shrinks if that
+    // still isn't enough
+    void fitQuality() {
+        auto& fields = m_fields;
+        if (fields->quality >= 1.0f || fields->qualityFitted) return;
+        fields->qualityFitted = true;
+
+        float capacity = static_cast<float>(m_uTotalParticles);
+        if (m_fEmissionRate * m_fLife > capacity) m_fEmissionRate *= fields->quality;
+        if (m_fEmissionRate > 0.0f && m_fEmissionRate * m_fLife > capacity) {
+            m_fLife = capacity / m_fEmissionRate;
+            m_fLifeVar = std::min(m_fLifeVar, m_fLife);
+        }
+    }
+
+    static void restoreParticles() {
+        g_particleDisable.restoreAll();
+    }
+
+    static void wakeAllParticles() {
+        g_particleSleep.wakeAll();
+    }
+
+    void resetSystem() {
+        CCParticleSystem::resetSystem();
+        g_particleSleep.wake(this);
+    }
+
+    void resumeSystem() {
+        CCParticleSystem::resumeSystem();
+        g_particleSleep.wake(this);
     }
 
     bool addParticle() {
         g_prof.particleAddCalls++;
-        if (g_settings.disableParticles) return false;
+
+        if (g_settings.limitParticles && m_fields->generation == g_particleBudget.generation) {
+            auto cls = m_fields->budgetClass;
+            if (!g_particleBudget.allow(cls, m_fields->counted)) {
+                g_particleBudget.denied[static_cast<size_t>(cls)]++;
+                g_prof.particlesDenied++;
+                return false;
+            }
+            if (!CCParticleSystem::addParticle()) return false;
+            g_particleBudget.live[static_cast<size_t>(cls)]++;
+            m_fields->counted++;
+            return true;
+        }
+
         return CCParticleSystem::addParticle();
     }
 };
 
+// pools resized after creation keep the tier they were created at
+
+class $modify(PerfixCCParticleSystemQuad, cocos2d::CCParticleSystemQuad) {
+    static void onModify(auto& self) {
+        bindHook(self, "cocos2d::CCParticleSystemQuad::setTotalParticles",
+            PerfixCCParticleSystem::reducedTierWanted);
+        bindHook(self, "cocos2d::CCParticleSystemQuad::draw", profilerWanted);
+    }
+
+    // batched systems never get here, their batch node draws them
+    void draw() {
+        g_particleBatcher.standaloneDraws++;
+        CCParticleSystemQuad::draw();
+    }
+
+    void setTotalParticles(unsigned int tp) {
+        float quality = static_cast<PerfixCCParticleSystem*>(static_cast<CCParticleSystem*>(this))->m_fields->quality;
+        if (quality < 1.0f) tp = std::max(1u, static_cast<unsigned>(tp * quality));
+        CCParticleSystemQuad::setTotalParticles(tp);
+    }
+};
+
+class $modify(PerfixCCParticleBatchNode, cocos2d::CCParticleBatchNode) {
+    static void onModify(auto& self) {
+        bindHook(self, "cocos2d::CCParticleBatchNode::draw", profilerWanted);
+    }
+
+    void draw() {
+        g_particleBatcher.batchDraws++;
+        g_particleBatcher.batchedSystems += static_cast<int>(this->getChildrenCount());
+        CCParticleBatchNode::draw();
+    }
+};
+
+// steps every deferred system across the pool. the scheduler is done, so
+// game logic won't touch them, and nothing is drawn until this returns
+static void runParticleBatch() {
+    if (g_particleJobs.empty()) return;
+    PROFILE_START;
+
+    auto jobs = std::move(g_particleJobs);
+    g_particleJobs.clear();
+
+    std::vector<WorkerPool::Task> tasks;
+    tasks.reserve(jobs.size());
+    for (auto& job : jobs) {
+        auto* system = static_cast<PerfixCCParticleSystem*>(job.system);
+        job.position = system->emitterPosition();
+        tasks.emplace_back([&job, system] { job.finished = system->simulate(job.dt, job.position); });
+    }
+    WorkerPool::get().run(tasks);
+
+    // gl uploads and removal stay on the game thread
+    for (auto& job : jobs) {
+        auto* system = job.system;
+        if (job.finished) {
+            system->unscheduleUpdate();
+            if (auto* parent = system->getParent()) parent->removeChild(system, true);
+        } else {
+            system->postStep();
+        }
+        system->release();
+    }
+
+    double ms = PROFILE_ELAPSED;
+    g_prof.parallelSystems += static_cast<int>(jobs.size());
+    g_prof.parallelParticleMs += ms;
+    g_prof.particleMs += ms;
+}
+
+class $modify(PerfixCCScheduler, cocos2d::CCScheduler) {
+    static void onModify(auto& self) {
+        bindHook(self, "cocos2d::CCScheduler::update",
+            [] { return g_settings.parallelParticles; }, runParticleBatch);
+    }
+
+    // joins the particle batch after every scheduled update ran and before
+    // the director visits the scene
+    void update(float dt) {
+        CCScheduler::update(dt);
+        runParticleBatch();
+    }
+};
+
 // game object
 
 class $modify(PerfixGameObject, GameObject) {
+    static void onModify(auto& self) {
+        bindHook(self, "GameObject::activateObject",
+            [] { return g_settings.disableHighDetail; });
+        bindHook(self, "GameObject::activateObject",
+            [] { return g_settings.glowLod; });
+        bindHook(self, "GameObject::deactivateObject",
+            [] { return g_settings.glowLod; });
+        bindHook(self, "GameObject::activateObject",
+            [] { return g_settings.learnObjectCosts; }, forgetActiveObjects);
+        bindHook(self, "GameObject::activateObject",
+            [] { return g_settings.objectLod > 0; });
+        bindHook(self, "GameObject::activateObject",
+            [] { return g_settings.cullTinyObjects; }, forgetTinyObjects);
+        bindHook(self, "GameObject::activateObject",
+            [] { return g_settings.expAggressiveCulling; });
+        bindHook(self, "GameObject::deactivateObject",
+            [] { return g_settings.learnObjectCosts; });
+        bindHook(self, "GameObject::setGlowColor",
+            [] { return g_settings.disableGlow; });
+        bindHook(self, "GameObject::setPosition",
+            [] { return g_settings.expCollisionGrid; });
+        bindHook(self, "GameObject::setRotation",
+            [] { return g_settings.expCollisionGrid; });
+        bindHook(self, "GameObject::setScaleX",
+            [] { return g_settings.expCollisionGrid; });
+        bindHook(self, "GameObject::setScaleY",
+            [] { return g_settings.expCollisionGrid; });
+        bindHook(self, "GameObject::setScale",
+            [] { return g_settings.expCollisionGrid; });
+    }
+
+    // stripped objects never get here. this catches ones created after load
+    void activateObject() {
+        if (g_settings.disableHighDetail && m_isHighDetail) {
+            g_prof.highDetailSkipped++;
+            return;
+        }
+        // same for types the lod tier dropped
+        if (g_settings.objectLod > 0 && g_objectCosts.lodDropped.contains(m_objectID)) return;
+        // the visibility pass asks again every frame, so growing back works
+        if (g_settings.cullTinyObjects && g_screenCull.tooSmall(this)) return;
+        if (g_settings.expAggressiveCulling && g_aggressiveCull.outside(this)) {
+            if (g_prof.enabled) g_aggressiveCull.held.insert(this);
+            return;
+        }
+        bool wasActive = getParent() != nullptr;
+        PROFILE_START;
+        GameObject::activateObject();
+        double ms = PROFILE_ELAPSED;
+        if (g_settings.learnObjectCosts) g_objectCosts.activated(this, ms);
+        // calls on objects that are already active do nothing, only time real ones
+        if (g_settings.expAggressiveCulling && !wasActive && getParent()) g_aggressiveCull.sampleActivation(ms);
+        if (g_settings.glowLod && m_glowSprite) g_glowLod.activate(this);
+    }
+
+    // the learn hooks are gone, nothing would retire these pointers
+    static void forgetActiveObjects() {
+        g_objectCosts.leaveLevel();
+    }
+
+    static void forgetTinyObjects() {
+        g_screenCull.culled.clear();
+    }
+
+    void deactivateObject(bool removeFromParent) {
+        g_glowLod.deactivate(this);
+        g_objectCosts.deactivated(this);
+        GameObject::deactivateObject(removeFromParent);
+    }
+
+    // stripped objects have no glow sprite left. objects created after load
+    // and the player still do, those are hidden here instead
     void setGlowColor(cocos2d::ccColor3B const& color) {
         if (g_settings.disableGlow) {
             if (m_glowSprite) {
                 m_glowSprite->setVisible(false);
-                g_prof.glowsDisabled++;
+                g_prof.glowsHidden++;
             }
             return;
         }
         GameObject::setGlowColor(color);
     }
 
-    void activateObject() {
-        if (g_settings.disableHighDetail && m_isHighDetail) {
-            g_prof.highDetailSkipped++;
-            return;
-        }
-        GameObject::activateObject();
+    // move actions and follow triggers reposition objects through here
+    void setPosition(CCPoint const& position) {
+        GameObject::setPosition(position);
+        regrid();
+    }
+
+    // rotate and scale triggers change the rect without moving the object
+    void setRotation(float rotation) {
+        GameObject::setRotation(rotation);
+        regrid();
+    }
+
+    void setScaleX(float scale) {
+        GameObject::setScaleX(scale);
+        regrid();
+    }
+
+    void setScaleY(float scale) {
+        GameObject::setScaleY(scale);
+        regrid();
+    }
+
+    void setScale(float scale) {
+        GameObject::setScale(scale);
+        regrid();
+    }
+
+    void regrid() {
+        if (g_collisionGrid.layer && CollisionGrid::tracked(this)) g_collisionGrid.moved(this);
+    }
+};
+
+// object sprites are visited through their batch nodes, that time is
+// shared out over the active objects for the cost table
+
+class $modify(PerfixCCSpriteBatchNode, cocos2d::CCSpriteBatchNode) {
+    static void onModify(auto& self) {
+        bindHook(self, "cocos2d::CCSpriteBatchNode::visit",
+            [] { return g_settings.learnObjectCosts; });
+    }
+
+    void visit() {
+        PROFILE_START;
+        CCSpriteBatchNode::visit();
+        PROFILE_ADD(g_objectCosts.visitMs);
     }
 };
 
 // effect manager
+// the color and opacity passes are hooked rather than the per-action step
+// they call, which is inlined on windows
 
 class $modify(PerfixGJEffectManager, GJEffectManager) {
+    static void onModify(auto& self) {
+        bindHook(self, "GJEffectManager::updatePulseEffects", profilerWanted);
+        bindHook(self, "GJEffectManager::updateColorEffects",
+            [] { return profilerWanted() || g_settings.expReduceColorUpdates; });
+        bindHook(self, "GJEffectManager::updateOpacityEffects", profilerWanted);
+    }
+
+    // color actions step at the color effects rate, with the skipped time
+    // banked so they still end on time
+    void updateColorEffects(float dt) {
+        g_effects.now += dt;
+        if (!g_throttle.consume(Throttled::ColorEffects, dt)) return;
+
+        PROFILE_START;
+        GJEffectManager::updateColorEffects(dt);
+        double ms = PROFILE_ELAPSED;
+        g_prof.effectMs += ms;
+        g_throttle.record(Throttled::ColorEffects, ms);
+    }
+
+    void updateOpacityEffects(float dt) {
+        PROFILE_START;
+        GJEffectManager::updateOpacityEffects(dt);
+        double ms = PROFILE_ELAPSED;
+        g_prof.opacityEffectMs += ms;
+        g_prof.effectMs += ms;
+    }
+
     void updatePulseEffects(float dt) {
         PROFILE_START;
         GJEffectManager::updatePulseEffects(dt);
@@ -92,6 +846,14 @@ class $modify(PerfixGJEffectManager, GJEffectManager) {
 // trigger tracking
 
 class $modify(PerfixEffectGameObject, EffectGameObject) {
+    static void onModify(auto& self) {
+        bindHook(self, "EffectGameObject::triggerActivated",
+            [] {
+                return profilerWanted() || g_settings.disableShake || g_settings.disablePulse ||
+                       g_settings.disableMoveEffects;
+            });
+    }
+
     void triggerActivated(float xPos) {
         g_prof.triggersActivated++;
 
@@ -109,6 +871,23 @@ class $modify(PerfixEffectGameObject, EffectGameObject) {
             g_prof.moveTriggers++;
         }
 
+        if (m_objectID == 899) { // Color Trigger
+            g_effects.started(g_effects.colorEnds, m_duration);
+        }
+
+        if (m_objectID == 1007) { // Alpha Trigger
+            if (g_settings.disableMoveEffects) {
+                // a zero length fade sets the group's alpha at once, nothing
+                // else the trigger does changes
+                float duration = m_duration;
+                m_duration = 0.0f;
+                EffectGameObject::triggerActivated(xPos);
+                m_duration = duration;
+                return;
+            }
+            g_effects.started(g_effects.opacityEnds, m_duration);
+        }
+
         if (m_objectID == 1268) { // Spawn Trigger
             g_prof.spawnTriggers++;
         }
@@ -120,9 +899,20 @@ class $modify(PerfixEffectGameObject, EffectGameObject) {
 // wave trail
 
 class $modify(PerfixHardStreak, HardStreak) {
+    struct Fields {
+        ThrottleCarry carry;  // each trail banks its own skipped dt
+    };
+
+    static void onModify(auto& self) {
+        bindHook(self, "HardStreak::updateStroke",
+            [] { return g_settings.expReduceWaveTrail; });
+    }
+
     void updateStroke(float dt) {
-        if (g_settings.expReduceWaveTrail && (g_throttle.frameCount % 2 == 0)) return;
+        if (!g_throttle.consume(Throttled::WaveTrail, m_fields->carry, dt)) return;
+        PROFILE_START;
         HardStreak::updateStroke(dt);
+        g_throttle.record(Throttled::WaveTrail, PROFILE_ELAPSED);
     }
 };
 
@@ -130,9 +920,17 @@ class $modify(PerfixHardStreak, HardStreak) {
 
 #ifdef GEODE_IS_ANDROID
 class $modify(PerfixLabelGameObject, LabelGameObject) {
+    static void onModify(auto& self) {
+        bindHook(self, "LabelGameObject::updateLabel",
+            [] { return g_settings.expThrottleLabels; });
+    }
+
+    // dt here is the value the label shows, not a time step, nothing to bank
     void updateLabel(float dt) {
-        if (g_settings.expThrottleLabels && (g_throttle.frameCount % 5 != 0)) return;
+        if (!g_throttle.shouldRun(Throttled::Labels)) return;
+        PROFILE_START;
         LabelGameObject::updateLabel(dt);
+        g_throttle.record(Throttled::Labels, PROFILE_ELAPSED);
     }
 };
 #endif
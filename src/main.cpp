@@ -1,11 +1,34 @@
 // perfix v2.2 - performance profiler and optimizer
 
 #include "globals.hpp"
+#include "collision_grid.hpp"
+#include "collision_kernel.hpp"
+#include "object_costs.hpp"
+#include "particle_batch.hpp"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
 
 // global state
 UltraProfiler g_prof;
 SettingsCache g_settings;
 ThrottleState g_throttle;
+SpawnLimiter g_spawns;
+SpawnGraph g_spawnGraph;
+ParticleBudget g_particleBudget;
+ParticleSleep g_particleSleep;
+ParticleDisable g_particleDisable;
+ParticleBatcher g_particleBatcher;
+GlowStrip g_glowStrip;
+GlowLod g_glowLod;
+SectionStrip g_highDetailStrip;
+SectionStrip g_lodStrip;
+ScreenSizeCull g_screenCull;
+AggressiveCull g_aggressiveCull;
+CollisionFilter g_collisionFilter;
+CollisionGrid g_collisionGrid;
+EffectTracker g_effects;
+ObjectCostTable g_objectCosts;
 
 // load settings from mod config
 void refreshSettings() {
@@ -21,12 +44,34 @@ void refreshSettings() {
     g_settings.disableHighDetail = mod->getSettingValue<bool>("disable-high-detail");
     g_settings.disableMoveEffects = mod->getSettingValue<bool>("disable-move-effects");
     g_settings.reducedParticles = mod->getSettingValue<bool>("reduced-particles");
+    g_settings.cullOffscreenParticles = mod->getSettingValue<bool>("cull-offscreen-particles");
+    g_settings.particleCullMargin = static_cast<int>(mod->getSettingValue<int64_t>("particle-cull-margin"));
+    g_settings.limitParticles = mod->getSettingValue<bool>("limit-particles");
+    g_settings.particleBudget = static_cast<int>(mod->getSettingValue<int64_t>("particle-budget"));
+    g_settings.simdParticles = mod->getSettingValue<bool>("simd-particles");
+    g_settings.parallelParticles = mod->getSettingValue<bool>("parallel-particles");
+    g_settings.sleepDormantParticles = mod->getSettingValue<bool>("sleep-dormant-particles");
+    auto quality = mod->getSettingValue<std::string>("particle-quality");
+    g_settings.particleQuality = quality == "25%" ? 0.25f : quality == "50%" ? 0.5f : 1.0f;
+    g_settings.batchParticles = mod->getSettingValue<bool>("batch-particles");
+    g_settings.glowLod = mod->getSettingValue<bool>("glow-lod");
+    g_settings.glowLodCount = static_cast<int>(mod->getSettingValue<int64_t>("glow-lod-count"));
+    g_settings.glowLodRadius = static_cast<int>(mod->getSettingValue<int64_t>("glow-lod-radius"));
+    g_settings.learnObjectCosts = mod->getSettingValue<bool>("learn-object-costs");
+    g_settings.cullTinyObjects = mod->getSettingValue<bool>("cull-tiny-objects");
+    g_settings.tinyObjectSize = static_cast<int>(mod->getSettingValue<int64_t>("tiny-object-size"));
+    auto lod = mod->getSettingValue<std::string>("object-lod");
+    g_settings.objectLod = static_cast<int>(
+        lod == "Low" ? ObjectLod::Low : lod == "Medium" ? ObjectLod::Medium :
+        lod == "High" ? ObjectLod::High : ObjectLod::Ultra);
     g_settings.expThrottleActions = mod->getSettingValue<bool>("exp-throttle-actions");
     g_settings.expSkipAreaEffects = mod->getSettingValue<bool>("exp-skip-area-effects");
     g_settings.expThrottleTransforms = mod->getSettingValue<bool>("exp-throttle-transforms");
     g_settings.expThrottleSpawns = mod->getSettingValue<bool>("exp-throttle-spawns");
     g_settings.expReduceCollisions = mod->getSettingValue<bool>("exp-reduce-collision-checks");
+    g_settings.expCollisionGrid = mod->getSettingValue<bool>("exp-collision-grid");
     g_settings.expAggressiveCulling = mod->getSettingValue<bool>("exp-aggressive-culling");
+    g_settings.aggressiveCullMargin = static_cast<int>(mod->getSettingValue<int64_t>("aggressive-cull-margin"));
     g_settings.expSkipFollowActions = mod->getSettingValue<bool>("exp-skip-follow-actions");
     g_settings.expReduceColorUpdates = mod->getSettingValue<bool>("exp-reduce-color-updates");
     g_settings.expThrottleGradients = mod->getSettingValue<bool>("exp-throttle-gradients");
@@ -36,9 +81,368 @@ void refreshSettings() {
     g_settings.expThrottlePlayerFollow = mod->getSettingValue<bool>("exp-throttle-player-follow");
     g_settings.expLimitEnterEffects = mod->getSettingValue<bool>("exp-limit-enter-effects");
     g_settings.expThrottleLabels = mod->getSettingValue<bool>("exp-throttle-labels");
+    g_settings.actionsHz = static_cast<int>(mod->getSettingValue<int64_t>("rate-actions"));
+    g_settings.gradientsHz = static_cast<int>(mod->getSettingValue<int64_t>("rate-gradients"));
+    g_settings.advancedFollowHz = static_cast<int>(mod->getSettingValue<int64_t>("rate-advanced-follow"));
+    g_settings.dynamicObjectsHz = static_cast<int>(mod->getSettingValue<int64_t>("rate-dynamic-objects"));
+    g_settings.playerFollowHz = static_cast<int>(mod->getSettingValue<int64_t>("rate-player-follow"));
+    g_settings.enterEffectsHz = static_cast<int>(mod->getSettingValue<int64_t>("rate-enter-effects"));
+    g_settings.waveTrailHz = static_cast<int>(mod->getSettingValue<int64_t>("rate-wave-trail"));
+    g_settings.labelsHz = static_cast<int>(mod->getSettingValue<int64_t>("rate-labels"));
+    g_settings.particlesHz = static_cast<int>(mod->getSettingValue<int64_t>("rate-particles"));
+    g_settings.collisionsHz = static_cast<int>(mod->getSettingValue<int64_t>("rate-collisions"));
+    g_settings.colorEffectsHz = static_cast<int>(mod->getSettingValue<int64_t>("rate-color-effects"));
+    g_settings.spawnRate = static_cast<int>(mod->getSettingValue<int64_t>("spawn-rate"));
+    g_settings.spawnBurst = static_cast<int>(mod->getSettingValue<int64_t>("spawn-burst"));
+    g_settings.spawnQueueLimit = static_cast<int>(mod->getSettingValue<int64_t>("spawn-queue-limit"));
+    g_settings.expCoalesceSpawns = mod->getSettingValue<bool>("exp-coalesce-spawns");
     g_settings.cacheValid = true;
+    g_throttle.configure();
+    syncHooks();
+}
+
+// setting and base divisor behind each throttled subsystem
+static bool slotEnabled(Throttled id) {
+    switch (id) {
+        case Throttled::MoveActions:
+        case Throttled::RotationActions: return g_settings.expThrottleActions;
+        case Throttled::Gradients: return g_settings.expThrottleGradients;
+        case Throttled::AdvancedFollow: return g_settings.expThrottleAdvancedFollow;
+        case Throttled::DynamicObjects: return g_settings.expThrottleDynamicObjects;
+        case Throttled::PlayerFollow: return g_settings.expThrottlePlayerFollow;
+        case Throttled::EnterEffects: return g_settings.expLimitEnterEffects;
+        case Throttled::WaveTrail: return g_settings.expReduceWaveTrail;
+        case Throttled::Labels: return g_settings.expThrottleLabels;
+        case Throttled::Particles: return g_settings.reducedParticles;
+        case Throttled::Collisions: return g_settings.expReduceCollisions;
+        case Throttled::ColorEffects: return g_settings.expReduceColorUpdates;
+        default: return false;
+    }
+}
+
+static int slotHz(Throttled id) {
+    switch (id) {
+        case Throttled::MoveActions:
+        case Throttled::RotationActions: return g_settings.actionsHz;
+        case Throttled::Gradients: return g_settings.gradientsHz;
+        case Throttled::AdvancedFollow: return g_settings.advancedFollowHz;
+        case Throttled::DynamicObjects: return g_settings.dynamicObjectsHz;
+        case Throttled::PlayerFollow: return g_settings.playerFollowHz;
+        case Throttled::EnterEffects: return g_settings.enterEffectsHz;
+        case Throttled::WaveTrail: return g_settings.waveTrailHz;
+        case Throttled::Labels: return g_settings.labelsHz;
+        case Throttled::Particles: return g_settings.particlesHz;
+        case Throttled::Collisions: return g_settings.collisionsHz;
+        case Throttled::ColorEffects: return g_settings.colorEffectsHz;
+        default: return 60;
+    }
+}
+
+bool throttlesWanted() {
+    for (size_t i = 0; i < kThrottledCount; i++) {
+        if (slotEnabled(static_cast<Throttled>(i))) return true;
+    }
+    return false;
+}
+
+void ThrottleState::configure() {
+    std::array<int, kThrottledCount> hz{};
+    for (size_t i = 0; i < kThrottledCount; i++) {
+        auto id = static_cast<Throttled>(i);
+        hz[i] = slotEnabled(id) ? std::max(slotHz(id), 1) : 0;
+    }
+    if (hz == configuredHz) return;
+    configuredHz = hz;
+    rebalancePending = true;
+}
+
+// frames until a slot with this divisor and phase is due again
+static int framesUntilDue(int frame, int divisor, int phase) {
+    return (divisor - (frame + phase) % divisor) % divisor;
+}
+
+void ThrottleState::tick(float dt) {
+    frameCount++;
+    tickedFrame = CCDirector::sharedDirector()->getTotalFrames();
+    frameDt = frameDt > 0.0 ? (frameDt * 0.95 + dt * 0.05) : dt;
+
+    // fold last frame's measured cost into the running average
+    for (auto& s : slots) {
+        if (s.active && s.due && s.frameMs > 0.0) {
+            s.costMs = s.costMs > 0.0 ? (s.costMs * 0.9 + s.frameMs * 0.1) : s.frameMs;
+        }
+        s.frameMs = 0.0;
+    }
+
+    if (rebalancePending || frameCount % 120 == 0) rebalance();
+
+    // time driven, so the rate is the same on every display. a slot fires on
+    // the frame closest to its deadline and keeps the remainder, which keeps
+    // the average rate exact even when it doesn't divide the refresh rate
+    for (auto& s : slots) {
+        if (!s.active) {
+            s.due = true;
+            continue;
+        }
+        s.accum += dt;
+        s.due = s.accum >= s.period - frameDt * 0.5;
+        if (s.due) {
+            s.accum -= s.period;
+            if (s.accum > s.period) s.accum = 0.0;
+        }
+    }
+}
+
+// greedy phase assignment over the hyperperiod of all active divisors:
+// most expensive slot first, each into the phase that keeps the heaviest
+// frame lightest. phases only move when the active slots or their divisors
+// change, the periodic call just refreshes the measured worst frame.
+// divisors are the frames per run at the measured refresh rate
+void ThrottleState::rebalance() {
+    rebalancePending = false;
+    bool layoutChanged = false;
+    for (size_t i = 0; i < kThrottledCount; i++) {
+        auto id = static_cast<Throttled>(i);
+        auto& s = slots[i];
+        bool enabled = slotEnabled(id);
+        double period = 1.0 / std::max(slotHz(id), 1);
+        int divisor = frameDt > 0.0 ? std::max(1, static_cast<int>(std::lround(period / frameDt))) : 1;
+        // near a rounding boundary frame time jitter would flip the divisor
+        // back and forth, so an active slot keeps its divisor until the
+        // ideal one is a quarter frame past the boundary
+        if (s.active && enabled && period == s.period && frameDt > 0.0 &&
+            std::abs(period / frameDt - s.divisor) <= 0.75) {
+            divisor = s.divisor;
+        }
+        if (enabled != s.active || divisor != s.divisor) layoutChanged = true;
+        if (enabled && !s.active) s.accum = 0.0;
+        s.active = enabled;
+        s.period = period;
+        s.divisor = divisor;
+    }
+
+    // bounded window, high refresh rates can make the true lcm huge
+    int period = 1;
+    for (auto& s : slots) {
+        if (!s.active) continue;
+        period = std::lcm(period, s.divisor);
+        if (period > 240) {
+            period = 240;
+            break;
+        }
+    }
+
+    // unmeasured slots get a nominal cost so they still spread out
+    auto cost = [](ThrottleSlot const& s) { return std::max(s.costMs, 0.01); };
+
+    auto worstLoad = [&](std::array<int, kThrottledCount> const& phases) {
+        std::vector<double> load(period, 0.0);
+        for (size_t i = 0; i < kThrottledCount; i++) {
+            auto& s = slots[i];
+            if (!s.active) continue;
+            for (int f = 0; f < period; f++) {
+                if ((f + phases[i]) % s.divisor == 0) load[f] += cost(s);
+            }
+        }
+        return *std::max_element(load.begin(), load.end());
+    };
+
+    std::array<int, kThrottledCount> current{};
+    for (size_t i = 0; i < kThrottledCount; i++) current[i] = slots[i].phase;
+    if (!layoutChanged) {
+        worstFrameMs = worstLoad(current);
+        return;
+    }
+
+    std::array<size_t, kThrottledCount> order;
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return cost(slots[a]) > cost(slots[b]);
+    });
+
+    std::vector<double> load(period, 0.0);
+    std::array<int, kThrottledCount> phases{};
+    for (size_t i : order) {
+        auto& s = slots[i];
+        if (!s.active) continue;
+
+        int bestPhase = 0;
+        double bestPeak = 0.0;
+        double bestSum = 0.0;
+        for (int p = 0; p < s.divisor; p++) {
+            double peak = 0.0;
+            double sum = 0.0;
+            for (int f = 0; f < period; f++) {
+                if ((f + p) % s.divisor != 0) continue;
+                peak = std::max(peak, load[f] + cost(s));
+                sum += load[f];
+            }
+            if (p == 0 || peak < bestPeak || (peak == bestPeak && sum < bestSum)) {
+                bestPhase = p;
+                bestPeak = peak;
+                bestSum = sum;
+            }
+        }
+
+        phases[i] = bestPhase;
+        for (int f = 0; f < period; f++) {
+            if ((f + bestPhase) % s.divisor == 0) load[f] += cost(s);
+        }
+    }
+
+    // a phase is just an offset into the accumulator
+    for (size_t i = 0; i < kThrottledCount; i++) {
+        auto& s = slots[i];
+        s.phase = phases[i];
+        if (!s.active) continue;
+        int wait = framesUntilDue(frameCount, s.divisor, s.phase);
+        s.accum = s.period - (wait + 1) * frameDt;
+    }
+    worstFrameMs = *std::max_element(load.begin(), load.end());
+}
+
+// objects without a glow sprite are the normal case, the game checks for
+// it everywhere, so a nulled sprite costs nothing from then on
+void GlowStrip::strip(GJBaseGameLayer* level) {
+    layer = level;
+    if (!level->m_objects) return;
+
+    for (auto* object : CCArrayExt<GameObject*>(level->m_objects)) {
+        auto* sprite = object->m_glowSprite;
+        if (!sprite) continue;
+
+        auto* parent = sprite->getParent();
+        stripped.push_back({object, sprite, parent, sprite->getZOrder()});
+        if (parent) sprite->removeFromParentAndCleanup(false);
+        object->m_glowSprite = nullptr;
+    }
+}
+
+void GlowStrip::restore(bool reattach) {
+    // a level that is gone gets nothing reattached, the refs just drop
+    reattach = reattach && layer && layer == GJBaseGameLayer::get();
+    for (auto& entry : stripped) {
+        entry.object->m_glowSprite = entry.sprite;
+        if (reattach && entry.parent && !entry.sprite->getParent()) {
+            entry.parent->addChild(entry.sprite, entry.zOrder);
+        }
+    }
+    stripped.clear();
+    layer = nullptr;
+}
+
+// new glows light up while there's room, the next selection sorts it out
+void GlowLod::activate(GameObject* object) {
+    if (!layer || layer != PlayLayer::get()) return;
+    if (!active.insert(object).second) return;
+    bool room = g_settings.glowLodCount == 0 || static_cast<int>(lit.size()) < g_settings.glowLodCount;
+    if (room) {
+        lit.insert(object);
+    } else {
+        object->m_glowSprite->setVisible(false);
+    }
+}
+
+void GlowLod::deactivate(GameObject* object) {
+    if (!active.erase(object)) return;
+    if (!lit.erase(object) && object->m_glowSprite) object->m_glowSprite->setVisible(true);
+}
+
+void GlowLod::update(GJBaseGameLayer* level, float dt) {
+    if (layer != level) {
+        forget();
+        layer = level;
+    }
+    selectAccum += dt;
+    if (selectAccum < 0.1f || !layer->m_player1 || !layer->m_objectLayer) return;
+    selectAccum = 0.0f;
+
+    // radius is in screen pixels, positions are in object layer space
+    auto center = layer->m_player1->getPosition();
+    float scale = std::max(0.01f, layer->m_objectLayer->getScale());
+    float radius = g_settings.glowLodRadius / scale;
+
+    std::vector<std::pair<float, GameObject*>> candidates;
+    candidates.reserve(active.size());
+    for (auto* object : active) {
+        if (!object->m_glowSprite) continue;
+        auto d = ccpSub(object->getPosition(), center);
+        float dist2 = d.x * d.x + d.y * d.y;
+        if (g_settings.glowLodRadius > 0 && dist2 > radius * radius) continue;
+        candidates.emplace_back(dist2, object);
+    }
+
+    size_t count = g_settings.glowLodCount;
+    if (count > 0 && candidates.size() > count) {
+        std::nth_element(candidates.begin(), candidates.begin() + count, candidates.end());
+        candidates.resize(count);
+    }
+
+    std::unordered_set<GameObject*> chosen;
+    chosen.reserve(candidates.size());
+    for (auto& [dist2, object] : candidates) chosen.insert(object);
+
+    // only touch the sprites whose state flips
+    for (auto* object : active) {
+        if (!object->m_glowSprite) continue;
+        bool on = chosen.contains(object);
+        if (on != lit.contains(object)) object->m_glowSprite->setVisible(on);
+    }
+    lit = std::move(chosen);
+}
+
+void GlowLod::restore() {
+    // the objects of a level that is gone can't be relit, only forgotten
+    if (layer && layer == PlayLayer::get()) {
+        for (auto* object : active) {
+            if (!lit.contains(object) && object->m_glowSprite) object->m_glowSprite->setVisible(true);
+        }
+    }
+    forget();
+}
+
+void SectionStrip::restore(bool readd) {
+    // only the current game layer is known to be alive
+    if (readd && layer && layer == GJBaseGameLayer::get()) {
+        for (auto& object : removed) layer->addToSection(object);
+    }
+    removed.clear();
+    layer = nullptr;
+}
+
+std::vector<HookBinding>& hookBindings() {
+    static std::vector<HookBinding> bindings;
+    return bindings;
+}
+
+// install only the hooks the current settings need
+void syncHooks() {
+    std::unordered_map<Hook*, bool> wanted;
+    for (auto& binding : hookBindings()) {
+        bool active = binding.wanted();
+        wanted[binding.hook] |= active;
+        if (binding.active && !active && binding.onDisable) binding.onDisable();
+        binding.active = active;
+    }
+
+    for (auto [hook, on] : wanted) {
+        if (on == hook->isEnabled()) continue;
+        auto res = on ? hook->enable() : hook->disable();
+        if (res.isErr()) {
+            log::warn("perfix: failed to toggle {}: {}", hook->getDisplayName(), res.unwrapErr());
+        }
+    }
 }
 
 $on_mod(Loaded) {
+    g_objectCosts.load();
     refreshSettings();
+    listenForAllSettingChanges([](std::shared_ptr<SettingV3>) {
+        refreshSettings();
+    });
+
+    if (Mod::get()->getSettingValue<bool>("benchmark-collision-kernel")) benchmarkCollisionKernel();
+    listenForSettingChanges("benchmark-collision-kernel", [](bool on) {
+        if (on) benchmarkCollisionKernel();
+    });
 }
@@ -0,0 +1,100 @@
+// per-object-type cost table
+
+#include "object_costs.hpp"
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+// types need a few samples before a tier acts on them
+constexpr int kMinActivations = 10;
+
+static std::filesystem::path tablePath() {
+    return Mod::get()->getSaveDir() / "object_costs.txt";
+}
+
+void ObjectCostTable::activated(GameObject* object, double ms) {
+    int id = object->m_objectID;
+    if (!active.try_emplace(object, id).second) return;
+    activeById[id]++;
+
+    auto& cost = costs[id];
+    auto size = object->getScaledContentSize();
+    cost.decoration = object->m_objectType == GameObjectType::Decoration;
+    cost.activations++;
+    cost.activateMs += ms;
+    cost.area += std::abs(size.width * size.height);
+}
+
+void ObjectCostTable::deactivated(GameObject* object) {
+    auto it = active.find(object);
+    if (it == active.end()) return;
+    activeById[it->second]--;
+    active.erase(it);
+}
+
+void ObjectCostTable::endFrame() {
+    if (!active.empty()) {
+        double perObject = visitMs / active.size();
+        for (auto& [id, count] : activeById) {
+            if (count <= 0) continue;
+            auto& cost = costs[id];
+            cost.visitMs += perObject * count;
+            cost.activeFrames += count;
+        }
+    }
+    visitMs = 0.0;
+}
+
+void ObjectCostTable::leaveLevel() {
+    active.clear();
+    activeById.clear();
+    visitMs = 0.0;
+}
+
+std::unordered_set<int> ObjectCostTable::dropped(ObjectLod lod) const {
+    static constexpr double kShare[] = {0.0, 0.15, 0.35, 0.6};
+    double share = kShare[static_cast<size_t>(lod)];
+    std::unordered_set<int> out;
+    if (share <= 0.0) return out;
+
+    std::vector<std::pair<double, int>> ranked;
+    double total = 0.0;
+    for (auto& [id, cost] : costs) {
+        if (!cost.decoration || cost.activations < kMinActivations) continue;
+        ranked.emplace_back(cost.score(), id);
+        total += cost.totalMs();
+    }
+    std::sort(ranked.begin(), ranked.end(), std::greater<>());
+
+    double shed = 0.0;
+    for (auto& [score, id] : ranked) {
+        if (shed >= total * share) break;
+        out.insert(id);
+        shed += costs.at(id).totalMs();
+    }
+    return out;
+}
+
+// one type per line: id decoration activations activateMs visitMs activeFrames area
+void ObjectCostTable::load() {
+    auto res = utils::file::readString(tablePath());
+    if (res.isErr()) return;
+
+    std::istringstream in(res.unwrap());
+    int id = 0;
+    ObjectCost cost;
+    while (in >> id >> cost.decoration >> cost.activations >> cost.activateMs >>
+           cost.visitMs >> cost.activeFrames >> cost.area) {
+        costs[id] = cost;
+    }
+}
+
+void ObjectCostTable::save() const {
+    std::ostringstream out;
+    for (auto& [id, cost] : costs) {
+        out << id << ' ' << cost.decoration << ' ' << cost.activations << ' ' << cost.activateMs << ' '
+            << cost.visitMs << ' ' << cost.activeFrames << ' ' << cost.area << '\n';
+    }
+    auto res = utils::file::writeString(tablePath(), out.str());
+    if (res.isErr()) log::warn("perfix: could not save object costs: {}", res.unwrapErr());
+}
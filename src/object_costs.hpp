@@ -0,0 +1,55 @@
+#pragma once
+
+// measured per-object-type costs and the lod tiers built from them
+
+#include "globals.hpp"
+
+struct ObjectCost {
+    bool decoration = false;
+    int activations = 0;
+    double activateMs = 0.0;
+    double visitMs = 0.0;       // share of the batch node visits
+    double activeFrames = 0.0;  // frames objects of this type spent active
+    double area = 0.0;          // summed over activations, object layer units
+
+    double totalMs() const { return activateMs + visitMs; }
+
+    // cost of one object for one frame on screen, per unit of its area
+    double score() const {
+        if (activeFrames <= 0.0 || activations == 0) return 0.0;
+        double perFrame = totalMs() / activeFrames;
+        return perFrame / std::max(1.0, area / activations);
+    }
+};
+
+enum class ObjectLod {
+    Ultra,
+    High,
+    Medium,
+    Low
+};
+
+struct ObjectCostTable {
+    std::unordered_map<int, ObjectCost> costs;
+    std::unordered_map<GameObject*, int> active;  // object -> its id
+    std::unordered_map<int, int> activeById;
+    double visitMs = 0.0;                          // batch visits this frame
+    std::unordered_set<int> lodDropped;            // ids the current level's tier dropped
+
+    void activated(GameObject* object, double ms);
+    void deactivated(GameObject* object);
+
+    // spreads the frame's visit time over the active objects
+    void endFrame();
+
+    void leaveLevel();
+
+    // decoration ids a tier drops, priciest per unit of area first until
+    // the tier's share of the learned decoration cost is covered
+    std::unordered_set<int> dropped(ObjectLod lod) const;
+
+    void load();
+    void save() const;
+};
+
+extern ObjectCostTable g_objectCosts;
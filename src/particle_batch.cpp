@@ -0,0 +1,144 @@
+// particle batching
+
+#include "particle_batch.hpp"
+#include <algorithm>
+
+// batch nodes draw their particles in their own space, the system's own
+// transform is never applied. only systems placed by position alone fit.
+// a batch also draws every child's quads whether it is visible or not
+static bool batchable(CCParticleSystem* system) {
+    if (!system->isVisible()) return false;
+    auto* parent = system->getParent();
+    if (!parent || typeinfo_cast<CCParticleBatchNode*>(parent)) return false;
+    if (system->getBatchNode() || !system->getTexture()) return false;
+    if (!typeinfo_cast<CCParticleSystemQuad*>(system)) return false;
+    return system->getScaleX() == 1.0f && system->getScaleY() == 1.0f &&
+           system->getRotationX() == 0.0f && system->getRotationY() == 0.0f &&
+           system->getSkewX() == 0.0f && system->getSkewY() == 0.0f;
+}
+
+static ParticleBatchKey batchKey(CCParticleSystem* system) {
+    auto blend = system->getBlendFunc();
+    return {system->getParent(), system->getTexture()->getName(), blend.src, blend.dst, system->getZOrder()};
+}
+
+// swaps a system between parents without running its cleanup. it keeps
+// its order of arrival, so going back puts it where it was among siblings
+static void reparent(CCNode* node, CCNode* parent) {
+    int z = node->getZOrder();
+    int tag = node->getTag();
+    unsigned arrival = node->getOrderOfArrival();
+    node->retain();
+    node->removeFromParentAndCleanup(false);
+    parent->addChild(node, z, tag);
+    node->setOrderOfArrival(arrival);
+    node->release();
+}
+
+void ParticleBatcher::hide(CCParticleSystem* system) {
+    if (std::find(hidden.begin(), hidden.end(), system) == hidden.end()) hidden.emplace_back(system);
+}
+
+void ParticleBatcher::sweepHidden() {
+    for (auto& [key, batch] : batches) {
+        if (batch->getParent() != key.parent) continue;
+        auto* children = batch->getChildren();
+        for (unsigned i = 0; children && i < children->count();) {
+            auto* system = static_cast<CCParticleSystem*>(children->objectAtIndex(i));
+            if (system->isVisible()) {
+                i++;
+                continue;
+            }
+            reparent(system, key.parent);
+            hide(system);
+        }
+    }
+
+    // shown again, batch it with the next flush. gone from the scene, forget it
+    for (auto it = hidden.begin(); it != hidden.end();) {
+        auto* system = it->data();
+        if (!system->getParent()) {
+            it = hidden.erase(it);
+        } else if (system->isVisible()) {
+            pending.emplace_back(system);
+            it = hidden.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void ParticleBatcher::queue(CCParticleSystem* system) {
+    pending.emplace_back(system);
+}
+
+void ParticleBatcher::flush() {
+    if (pending.empty()) return;
+
+    // batches whose parent went away are dead
+    for (auto it = batches.begin(); it != batches.end();) {
+        if (it->second->getParent() != it->first.parent) {
+            it = batches.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // a loner may have entered again, group each system once
+    std::unordered_set<CCParticleSystem*> seen;
+    std::unordered_map<ParticleBatchKey, std::vector<CCParticleSystem*>, ParticleBatchKeyHash> groups;
+    for (auto* list : {&pending, &loners}) {
+        for (auto& system : *list) {
+            if (!seen.insert(system).second) continue;
+            if (!batchable(system)) {
+                if (!system->isVisible() && system->getParent()) hide(system);
+                continue;
+            }
+            groups[batchKey(system)].push_back(system);
+        }
+    }
+
+    std::vector<Ref<CCParticleSystem>> waiting;
+    for (auto& [key, systems] : groups) {
+        auto it = batches.find(key);
+        if (it == batches.end()) {
+            if (systems.size() < 2) {
+                waiting.emplace_back(systems.front());
+                continue;
+            }
+
+            // the batch takes the first system's place among same-z siblings
+            unsigned arrival = systems.front()->getOrderOfArrival();
+            for (auto* system : systems) arrival = std::min(arrival, system->getOrderOfArrival());
+
+            auto* batch = CCParticleBatchNode::createWithTexture(systems.front()->getTexture(), 64);
+            batch->setBlendFunc({key.blendSrc, key.blendDst});
+            key.parent->addChild(batch, key.zOrder);
+            batch->setOrderOfArrival(arrival);
+            it = batches.emplace(key, batch).first;
+        }
+        for (auto* system : systems) reparent(system, it->second);
+    }
+
+    pending.clear();
+    loners = std::move(waiting);
+}
+
+void ParticleBatcher::unbatchAll() {
+    pending.clear();
+    loners.clear();
+    hidden.clear();
+    for (auto& [key, batch] : batches) {
+        auto* children = batch->getChildren();
+        while (children && children->count() > 0) {
+            auto* system = static_cast<CCNode*>(children->objectAtIndex(0));
+            if (batch->getParent() == key.parent) {
+                reparent(system, key.parent);
+            } else {
+                batch->removeChild(system, true);
+            }
+        }
+        batch->removeFromParentAndCleanup(true);
+    }
+    batches.clear();
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+// groups standalone particle systems into shared CCParticleBatchNodes
+
+#include "globals.hpp"
+
+// systems can only share a batch if they draw alike and sit in the same
+// place in the tree
+struct ParticleBatchKey {
+    cocos2d::CCNode* parent = nullptr;
+    GLuint texture = 0;
+    GLenum blendSrc = 0;
+    GLenum blendDst = 0;
+    int zOrder = 0;
+
+    bool operator==(ParticleBatchKey const&) const = default;
+};
+
+struct ParticleBatchKeyHash {
+    size_t operator()(ParticleBatchKey const& key) const {
+        size_t h = std::hash<void*>()(key.parent);
+        h = h * 31 + key.texture;
+        h = h * 31 + key.blendSrc;
+        h = h * 31 + key.blendDst;
+        return h * 31 + static_cast<size_t>(key.zOrder);
+    }
+};
+
+struct ParticleBatcher {
+    std::vector<Ref<cocos2d::CCParticleSystem>> pending;  // entered the scene since the last flush
+    std::vector<Ref<cocos2d::CCParticleSystem>> loners;   // nothing to share a batch with yet
+    std::vector<Ref<cocos2d::CCParticleSystem>> hidden;   // waiting to be shown before batching
+    std::unordered_map<ParticleBatchKey, Ref<cocos2d::CCParticleBatchNode>, ParticleBatchKeyHash> batches;
+
+    // counted by the draw hooks, this frame and the last full one
+    int standaloneDraws = 0;
+    int batchDraws = 0;
+    int batchedSystems = 0;     // systems drawn through those batches
+    int drawsLast = 0;
+    int unbatchedDrawsLast = 0; // what the same frame costs without batching
+
+    void queue(cocos2d::CCParticleSystem* system);
+    void hide(cocos2d::CCParticleSystem* system);
+
+    // moves everything queued into a batch with its lookalikes. a system
+    // with nothing to share with stays standalone until one shows up
+    void flush();
+
+    // puts every batched system back under its own parent
+    void unbatchAll();
+
+    // takes hidden systems out of their batch, which would keep drawing
+    // them, and queues ones shown again. once per frame before flush
+    void sweepHidden();
+
+    void beginFrame() {
+        drawsLast = standaloneDraws + batchDraws;
+        unbatchedDrawsLast = standaloneDraws + batchedSystems;
+        standaloneDraws = batchDraws = batchedSystems = 0;
+    }
+};
+
+extern ParticleBatcher g_particleBatcher;
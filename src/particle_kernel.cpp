@@ -0,0 +1,247 @@
+// structure-of-arrays particle integration
+
+#include "particle_kernel.hpp"
+#include "simd.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+#if defined(PERFIX_AVX2)
+using vf = __m256;
+constexpr unsigned kLanes = 8;
+inline vf vload(float const* p) { return _mm256_loadu_ps(p); }
+inline void vstore(float* p, vf v) { _mm256_storeu_ps(p, v); }
+inline vf vset(float x) { return _mm256_set1_ps(x); }
+inline vf vadd(vf a, vf b) { return _mm256_add_ps(a, b); }
+inline vf vsub(vf a, vf b) { return _mm256_sub_ps(a, b); }
+inline vf vmul(vf a, vf b) { return _mm256_mul_ps(a, b); }
+inline vf vmax(vf a, vf b) { return _mm256_max_ps(a, b); }
+inline vf vinvlen(vf len2) {
+    vf mask = _mm256_cmp_ps(len2, _mm256_setzero_ps(), _CMP_GT_OQ);
+    vf inv = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(len2));
+    return _mm256_and_ps(mask, inv);
+}
+#elif defined(PERFIX_SSE2)
+using vf = __m128;
+constexpr unsigned kLanes = 4;
+inline vf vload(float const* p) { return _mm_loadu_ps(p); }
+inline void vstore(float* p, vf v) { _mm_storeu_ps(p, v); }
+inline vf vset(float x) { return _mm_set1_ps(x); }
+inline vf vadd(vf a, vf b) { return _mm_add_ps(a, b); }
+inline vf vsub(vf a, vf b) { return _mm_sub_ps(a, b); }
+inline vf vmul(vf a, vf b) { return _mm_mul_ps(a, b); }
+inline vf vmax(vf a, vf b) { return _mm_max_ps(a, b); }
+inline vf vinvlen(vf len2) {
+    vf mask = _mm_cmpgt_ps(len2, _mm_setzero_ps());
+    vf inv = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(len2));
+    return _mm_and_ps(mask, inv);
+}
+#elif defined(PERFIX_NEON_DIV)
+// armv7 neon has no vector divide or sqrt, it takes the scalar path
+using vf = float32x4_t;
+constexpr unsigned kLanes = 4;
+inline vf vload(float const* p) { return vld1q_f32(p); }
+inline void vstore(float* p, vf v) { vst1q_f32(p, v); }
+inline vf vset(float x) { return vdupq_n_f32(x); }
+inline vf vadd(vf a, vf b) { return vaddq_f32(a, b); }
+inline vf vsub(vf a, vf b) { return vsubq_f32(a, b); }
+inline vf vmul(vf a, vf b) { return vmulq_f32(a, b); }
+inline vf vmax(vf a, vf b) { return vmaxq_f32(a, b); }
+inline vf vinvlen(vf len2) {
+    uint32x4_t mask = vcgtq_f32(len2, vdupq_n_f32(0.0f));
+    vf inv = vdivq_f32(vdupq_n_f32(1.0f), vsqrtq_f32(len2));
+    return vreinterpretq_f32_u32(vandq_u32(mask, vreinterpretq_u32_f32(inv)));
+}
+#endif
+
+// reference path, also handles the tail the vector loop leaves over
+void integrateScalar(ParticleSoA& s, unsigned begin, unsigned end, ParticleStep const& step) {
+    float dt = step.dt;
+    for (unsigned i = begin; i < end; i++) {
+        s.ttl[i] -= dt;
+
+        if (step.gravityMode) {
+            float nx = 0.0f;
+            float ny = 0.0f;
+            if (s.posX[i] || s.posY[i]) {
+                float inv = 1.0f / std::sqrt(s.posX[i] * s.posX[i] + s.posY[i] * s.posY[i]);
+                nx = s.posX[i] * inv;
+                ny = s.posY[i] * inv;
+            }
+            float ax = nx * s.radialAccel[i] - ny * s.tangentialAccel[i] + step.gravityX;
+            float ay = ny * s.radialAccel[i] + nx * s.tangentialAccel[i] + step.gravityY;
+            s.dirX[i] += ax * dt;
+            s.dirY[i] += ay * dt;
+            s.posX[i] += s.dirX[i] * dt;
+            s.posY[i] += s.dirY[i] * dt;
+        }
+
+        s.r[i] += s.dr[i] * dt;
+        s.g[i] += s.dg[i] * dt;
+        s.b[i] += s.db[i] * dt;
+        s.a[i] += s.da[i] * dt;
+        s.size[i] = std::max(0.0f, s.size[i] + s.deltaSize[i] * dt);
+        s.rotation[i] += s.deltaRotation[i] * dt;
+    }
+}
+
+// radius mode needs sin/cos, which stay scalar
+void integrateRadius(ParticleSoA& s, unsigned count, float dt) {
+    for (unsigned i = 0; i < count; i++) {
+        s.angle[i] += s.degreesPerSecond[i] * dt;
+        s.radius[i] += s.deltaRadius[i] * dt;
+        s.posX[i] = -std::cos(s.angle[i]) * s.radius[i];
+        s.posY[i] = -std::sin(s.angle[i]) * s.radius[i];
+    }
+}
+
+bool nearlyEqual(float a, float b) {
+    return std::abs(a - b) <= 1e-3f + 1e-4f * std::abs(b);
+}
+
+} // namespace
+
+void ParticleSoA::load(tCCParticle const* particles, unsigned count, bool gravityMode) {
+    for (auto* v : {&posX, &posY, &r, &g, &b, &a, &dr, &dg, &db, &da,
+                    &size, &deltaSize, &rotation, &deltaRotation, &ttl}) {
+        v->resize(count);
+    }
+    if (gravityMode) {
+        for (auto* v : {&dirX, &dirY, &radialAccel, &tangentialAccel}) v->resize(count);
+    } else {
+        for (auto* v : {&angle, &degreesPerSecond, &radius, &deltaRadius}) v->resize(count);
+    }
+
+    for (unsigned i = 0; i < count; i++) {
+        auto const& p = particles[i];
+        posX[i] = p.pos.x;
+        posY[i] = p.pos.y;
+        r[i] = p.color.r;
+        g[i] = p.color.g;
+        b[i] = p.color.b;
+        a[i] = p.color.a;
+        dr[i] = p.deltaColor.r;
+        dg[i] = p.deltaColor.g;
+        db[i] = p.deltaColor.b;
+        da[i] = p.deltaColor.a;
+        size[i] = p.size;
+        deltaSize[i] = p.deltaSize;
+        rotation[i] = p.rotation;
+        deltaRotation[i] = p.deltaRotation;
+        ttl[i] = p.timeToLive;
+        if (gravityMode) {
+            dirX[i] = p.modeA.dir.x;
+            dirY[i] = p.modeA.dir.y;
+            radialAccel[i] = p.modeA.radialAccel;
+            tangentialAccel[i] = p.modeA.tangentialAccel;
+        } else {
+            angle[i] = p.modeB.angle;
+            degreesPerSecond[i] = p.modeB.degreesPerSecond;
+            radius[i] = p.modeB.radius;
+            deltaRadius[i] = p.modeB.deltaRadius;
+        }
+    }
+}
+
+// only the fields integration changes are written back
+void ParticleSoA::store(tCCParticle* particles, unsigned count, bool gravityMode) const {
+    for (unsigned i = 0; i < count; i++) {
+        auto& p = particles[i];
+        p.pos.x = posX[i];
+        p.pos.y = posY[i];
+        p.color.r = r[i];
+        p.color.g = g[i];
+        p.color.b = b[i];
+        p.color.a = a[i];
+        p.size = size[i];
+        p.rotation = rotation[i];
+        p.timeToLive = ttl[i];
+        if (gravityMode) {
+            p.modeA.dir.x = dirX[i];
+            p.modeA.dir.y = dirY[i];
+        } else {
+            p.modeB.angle = angle[i];
+            p.modeB.radius = radius[i];
+        }
+    }
+}
+
+bool ParticleSoA::matchesAt(unsigned i, tCCParticle const& p, bool gravityMode) const {
+    if (!nearlyEqual(p.pos.x, posX[i]) || !nearlyEqual(p.pos.y, posY[i])) return false;
+    if (!nearlyEqual(p.color.r, r[i]) || !nearlyEqual(p.color.g, g[i]) ||
+        !nearlyEqual(p.color.b, b[i]) || !nearlyEqual(p.color.a, a[i])) return false;
+    if (!nearlyEqual(p.size, size[i]) || !nearlyEqual(p.rotation, rotation[i])) return false;
+    if (!nearlyEqual(p.timeToLive, ttl[i])) return false;
+    if (gravityMode && (!nearlyEqual(p.modeA.dir.x, dirX[i]) || !nearlyEqual(p.modeA.dir.y, dirY[i]))) return false;
+    return true;
+}
+
+bool ParticleSoA::matches(tCCParticle const* particles, unsigned count, bool gravityMode) const {
+    for (unsigned i = 0; i < count; i++) {
+        if (!matchesAt(i, particles[i], gravityMode)) return false;
+    }
+    return true;
+}
+
+void integrateParticles(ParticleSoA& s, unsigned count, ParticleStep const& step) {
+    unsigned i = 0;
+
+#if defined(PERFIX_AVX2) || defined(PERFIX_SSE2) || defined(PERFIX_NEON_DIV)
+    vf dt = vset(step.dt);
+    vf gx = vset(step.gravityX);
+    vf gy = vset(step.gravityY);
+    vf zero = vset(0.0f);
+
+    for (; i + kLanes <= count; i += kLanes) {
+        vstore(&s.ttl[i], vsub(vload(&s.ttl[i]), dt));
+
+        if (step.gravityMode) {
+            vf x = vload(&s.posX[i]);
+            vf y = vload(&s.posY[i]);
+            vf inv = vinvlen(vadd(vmul(x, x), vmul(y, y)));
+            vf nx = vmul(x, inv);
+            vf ny = vmul(y, inv);
+
+            vf radial = vload(&s.radialAccel[i]);
+            vf tangential = vload(&s.tangentialAccel[i]);
+            vf ax = vadd(vsub(vmul(nx, radial), vmul(ny, tangential)), gx);
+            vf ay = vadd(vadd(vmul(ny, radial), vmul(nx, tangential)), gy);
+
+            vf dirX = vadd(vload(&s.dirX[i]), vmul(ax, dt));
+            vf dirY = vadd(vload(&s.dirY[i]), vmul(ay, dt));
+            vstore(&s.dirX[i], dirX);
+            vstore(&s.dirY[i], dirY);
+            vstore(&s.posX[i], vadd(x, vmul(dirX, dt)));
+            vstore(&s.posY[i], vadd(y, vmul(dirY, dt)));
+        }
+
+        vstore(&s.r[i], vadd(vload(&s.r[i]), vmul(vload(&s.dr[i]), dt)));
+        vstore(&s.g[i], vadd(vload(&s.g[i]), vmul(vload(&s.dg[i]), dt)));
+        vstore(&s.b[i], vadd(vload(&s.b[i]), vmul(vload(&s.db[i]), dt)));
+        vstore(&s.a[i], vadd(vload(&s.a[i]), vmul(vload(&s.da[i]), dt)));
+        vstore(&s.size[i], vmax(zero, vadd(vload(&s.size[i]), vmul(vload(&s.deltaSize[i]), dt))));
+        vstore(&s.rotation[i], vadd(vload(&s.rotation[i]), vmul(vload(&s.deltaRotation[i]), dt)));
+    }
+#endif
+
+    integrateScalar(s, i, count, step);
+    if (!step.gravityMode) integrateRadius(s, count, step.dt);
+}
+
+ParticleSoA& particleScratch() {
+    thread_local ParticleSoA scratch;
+    return scratch;
+}
+
+char const* particleKernelName() {
+#if defined(PERFIX_AVX2)
+    return "AVX2";
+#elif defined(PERFIX_SSE2)
+    return "SSE2";
+#elif defined(PERFIX_NEON_DIV)
+    return "NEON";
+#else
+    return "scalar";
+#endif
+}
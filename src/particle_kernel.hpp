@@ -0,0 +1,50 @@
+#pragma once
+
+// structure-of-arrays particle integration (SSE2 / AVX2 / NEON)
+
+#include <Geode/Geode.hpp>
+#include <vector>
+
+using namespace geode::prelude;
+
+// per-step inputs shared by every particle of a system
+struct ParticleStep {
+    float dt = 0.0f;
+    bool gravityMode = true;
+    float gravityX = 0.0f;
+    float gravityY = 0.0f;
+};
+
+// mirror of the fields CCParticleSystem::update touches, one array per field
+struct ParticleSoA {
+    std::vector<float> posX, posY;
+    std::vector<float> r, g, b, a;
+    std::vector<float> dr, dg, db, da;
+    std::vector<float> size, deltaSize;
+    std::vector<float> rotation, deltaRotation;
+    std::vector<float> ttl;
+
+    // gravity mode
+    std::vector<float> dirX, dirY;
+    std::vector<float> radialAccel, tangentialAccel;
+
+    // radius mode
+    std::vector<float> angle, degreesPerSecond;
+    std::vector<float> radius, deltaRadius;
+
+    void load(tCCParticle const* particles, unsigned count, bool gravityMode);
+    void store(tCCParticle* particles, unsigned count, bool gravityMode) const;
+
+    // true if particles hold what this state predicts, within tolerance
+    bool matches(tCCParticle const* particles, unsigned count, bool gravityMode) const;
+    bool matchesAt(unsigned i, tCCParticle const& particle, bool gravityMode) const;
+};
+
+// advances count particles by one step, same math as the scalar cocos loop
+void integrateParticles(ParticleSoA& soa, unsigned count, ParticleStep const& step);
+
+// scratch state, one per thread so pool workers can step systems too
+ParticleSoA& particleScratch();
+
+// name of the compiled vector path, for the overlay
+char const* particleKernelName();
@@ -0,0 +1,20 @@
+#pragma once
+
+// vector instruction sets the kernels can use on this target. at most one
+// of PERFIX_AVX2 and PERFIX_SSE2 is set on x86. on arm PERFIX_NEON_CMP means
+// float loads, compares and bit ops, which armv7 has. PERFIX_NEON_DIV adds
+// vector divide and sqrt, which only aarch64 has
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define PERFIX_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PERFIX_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define PERFIX_NEON_CMP 1
+#if defined(__aarch64__)
+#define PERFIX_NEON_DIV 1
+#endif
+#endif
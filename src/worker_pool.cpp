@@ -0,0 +1,91 @@
+// small work-stealing thread pool
+
+#include "worker_pool.hpp"
+#include <algorithm>
+
+WorkerPool& WorkerPool::get() {
+    static auto* pool = new WorkerPool();
+    return *pool;
+}
+
+WorkerPool::WorkerPool() {
+    // leave a core for the game thread, more than 7 helpers don't pay off
+    unsigned cores = std::thread::hardware_concurrency();
+    size_t workers = cores > 2 ? std::min(cores - 1, 7u) : 0;
+
+    for (size_t i = 0; i <= workers; i++) {
+        m_queues.push_back(std::make_unique<Queue>());
+    }
+    for (size_t i = 0; i < workers; i++) {
+        m_threads.emplace_back([this, i] { workerLoop(i); });
+        m_threads.back().detach();
+    }
+}
+
+WorkerPool::Task* WorkerPool::take(size_t self) {
+    {
+        auto& own = *m_queues[self];
+        std::lock_guard lock(own.lock);
+        if (!own.tasks.empty()) {
+            auto* task = own.tasks.front();
+            own.tasks.pop_front();
+            return task;
+        }
+    }
+    for (size_t i = 1; i < m_queues.size(); i++) {
+        auto& victim = *m_queues[(self + i) % m_queues.size()];
+        std::lock_guard lock(victim.lock);
+        if (!victim.tasks.empty()) {
+            auto* task = victim.tasks.back();
+            victim.tasks.pop_back();
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+void WorkerPool::workerLoop(size_t self) {
+    uint64_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock lock(m_wakeLock);
+            m_wake.wait(lock, [&] { return m_generation != seen; });
+            seen = m_generation;
+        }
+        while (auto* task = take(self)) {
+            (*task)();
+            m_pending.fetch_sub(1, std::memory_order_acq_rel);
+        }
+    }
+}
+
+void WorkerPool::run(std::vector<Task>& tasks) {
+    if (tasks.empty()) return;
+
+    size_t caller = m_queues.size() - 1;
+    if (m_threads.empty()) {
+        for (auto& task : tasks) task();
+        return;
+    }
+
+    m_pending.store(static_cast<int>(tasks.size()), std::memory_order_release);
+    for (size_t i = 0; i < tasks.size(); i++) {
+        auto& queue = *m_queues[i % m_queues.size()];
+        std::lock_guard lock(queue.lock);
+        queue.tasks.push_back(&tasks[i]);
+    }
+    {
+        std::lock_guard lock(m_wakeLock);
+        m_generation++;
+    }
+    m_wake.notify_all();
+
+    while (auto* task = take(caller)) {
+        (*task)();
+        m_pending.fetch_sub(1, std::memory_order_acq_rel);
+    }
+    // the last few tasks are still running on workers
+    while (m_pending.load(std::memory_order_acquire) > 0) {
+        std::this_thread::yield();
+    }
+}
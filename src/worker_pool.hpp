@@ -0,0 +1,46 @@
+#pragma once
+
+// small work-stealing thread pool for per-frame batches
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkerPool {
+public:
+    using Task = std::function<void()>;
+
+    // started on first use and never torn down, joining threads while the
+    // game unloads the mod can deadlock on some platforms
+    static WorkerPool& get();
+
+    // runs every task and returns once all of them finished. the calling
+    // thread works through the batch too instead of just waiting
+    void run(std::vector<Task>& tasks);
+
+    size_t workerCount() const { return m_threads.size(); }
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<Task*> tasks;
+    };
+
+    WorkerPool();
+    void workerLoop(size_t self);
+
+    // own queue from the front, everyone else's from the back
+    Task* take(size_t self);
+
+    std::vector<std::thread> m_threads;
+    std::vector<std::unique_ptr<Queue>> m_queues;  // one per worker, plus the caller
+    std::atomic<int> m_pending{0};
+    std::mutex m_wakeLock;
+    std::condition_variable m_wake;
+    uint64_t m_generation = 0;
+};